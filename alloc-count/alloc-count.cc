@@ -0,0 +1,64 @@
+#include <gtest/gtest.h>
+
+#include "alloc-count.hh"
+
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+
+
+TEST(alloc_count, operator_new_and_delete)
+{
+    auto const c = alloc_count::during([]{
+        delete new int;
+        delete[] new int[4];
+        ::operator delete(::operator new(10, std::align_val_t{64}), std::align_val_t{64});
+        delete new (std::nothrow) int;
+    });
+    EXPECT_EQ(c.allocations, 4u);
+    EXPECT_EQ(c.deallocations, 4u);
+    EXPECT_GE(c.bytes, sizeof (int) * 6 + 10);
+}
+
+TEST(alloc_count, c_functions)
+{
+    auto const c = alloc_count::during([]{
+        auto *p = std::malloc(100);
+        p = std::realloc(p, 200);
+        std::free(p);
+        std::free(std::calloc(3, 4));
+        std::free(std::aligned_alloc(64, 64));
+        void *q;
+        EXPECT_EQ(posix_memalign(&q, 64, 8), 0);
+        std::free(q);
+        std::free(nullptr);
+    });
+    EXPECT_EQ(c.allocations, 5u);
+    EXPECT_EQ(c.deallocations, 5u);
+    EXPECT_EQ(c.bytes, 100u + 200 + 12 + 64 + 8);
+}
+
+TEST(alloc_count, containers)
+{
+    std::vector<int> v;
+    v.reserve(10);
+    EXPECT_NO_ALLOC(for (int i = 0;  i < 10;  ++i) { v.push_back(i); });
+    EXPECT_ALLOCATIONS(1, v.push_back(10));
+    EXPECT_ALLOCATIONS(1, std::string s(100, 'x'));
+    EXPECT_NO_ALLOC(std::string s(3, 'x'));     // small string
+}
+
+TEST(alloc_count, other_threads_not_counted)
+{
+    auto const c = alloc_count::during([]{
+        std::thread t{[]{
+            for (int i = 0;  i < 100;  ++i) {
+                delete new int;
+            }
+        }};
+        t.join();
+    });
+    // only the thread's own state, allocated by this thread
+    EXPECT_LT(c.allocations, 5u);
+}
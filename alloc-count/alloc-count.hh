@@ -0,0 +1,216 @@
+#ifndef ALLOC_COUNT_HH
+#define ALLOC_COUNT_HH
+
+#include <cerrno>
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+
+/*
+  Per-thread allocation counting for tests, to catch allocations creeping into hot paths.  It
+  replaces the global operator new and delete and interposes the C allocation functions, so it
+  must be included in exactly one translation unit of a program (after <gtest/gtest.h>, for the
+  EXPECT macros).
+
+  * EXPECT_NO_ALLOC(statements);            // fails if the statements allocate
+  * EXPECT_ALLOCATIONS(n, statements);      // fails unless they allocate exactly n times
+  * alloc_count::during([&]{ ... })         // allocations, deallocations and bytes requested
+
+  Only the calling thread's allocations are counted, so other threads can't disturb the results.
+  The C functions are forwarded to glibc's __libc_malloc() and friends.
+ */
+
+namespace alloc_count
+{
+    struct counts
+    {
+        unsigned long allocations;
+        unsigned long deallocations;
+        std::size_t bytes;
+
+        counts operator-(const counts& o) const
+        {
+            return { allocations - o.allocations, deallocations - o.deallocations, bytes - o.bytes };
+        }
+
+        bool operator==(const counts&) const = default;
+    };
+
+    inline thread_local counts thread_counts = {0, 0, 0};
+
+    // This thread's totals so far
+    inline counts now()
+    {
+        return thread_counts;
+    }
+
+    // This thread's allocations during f()
+    template<typename F>
+    counts during(F&& f)
+    {
+        auto const before = now();
+        f();
+        return now() - before;
+    }
+
+    namespace detail
+    {
+        inline void *allocated(void *p, std::size_t size) noexcept
+        {
+            if (p) {
+                ++thread_counts.allocations;
+                thread_counts.bytes += size;
+            }
+            return p;
+        }
+
+        inline void freed(void *p) noexcept
+        {
+            if (p) {
+                ++thread_counts.deallocations;
+            }
+        }
+    }
+}
+
+#ifdef EXPECT_EQ
+#define EXPECT_ALLOCATIONS(n, ...) \
+    EXPECT_EQ(::alloc_count::during([&]{ __VA_ARGS__; }).allocations, static_cast<unsigned long>(n)) \
+        << "allocations made by: " #__VA_ARGS__
+#define EXPECT_NO_ALLOC(...) EXPECT_ALLOCATIONS(0, __VA_ARGS__)
+#endif
+
+
+// C allocation functions
+
+extern "C" {
+    void *__libc_malloc(std::size_t);
+    void *__libc_calloc(std::size_t, std::size_t);
+    void *__libc_realloc(void*, std::size_t);
+    void *__libc_memalign(std::size_t, std::size_t);
+    void __libc_free(void*);
+
+    void *malloc(std::size_t size)
+    {
+        return alloc_count::detail::allocated(__libc_malloc(size), size);
+    }
+
+    void *calloc(std::size_t n, std::size_t size)
+    {
+        return alloc_count::detail::allocated(__libc_calloc(n, size), n * size);
+    }
+
+    void *realloc(void *p, std::size_t size)
+    {
+        auto *const q = __libc_realloc(p, size);
+        if (q || !size) {
+            alloc_count::detail::freed(p);
+        }
+        return alloc_count::detail::allocated(q, size);
+    }
+
+    void *aligned_alloc(std::size_t alignment, std::size_t size)
+    {
+        return alloc_count::detail::allocated(__libc_memalign(alignment, size), size);
+    }
+
+    void *memalign(std::size_t alignment, std::size_t size)
+    {
+        return alloc_count::detail::allocated(__libc_memalign(alignment, size), size);
+    }
+
+    int posix_memalign(void **p, std::size_t alignment, std::size_t size)
+    {
+        if (alignment < sizeof (void*) || (alignment & (alignment - 1))) {
+            return EINVAL;
+        }
+        *p = alloc_count::detail::allocated(__libc_memalign(alignment, size), size);
+        return *p ? 0 : ENOMEM;
+    }
+
+    void free(void *p)
+    {
+        alloc_count::detail::freed(p);
+        __libc_free(p);
+    }
+}
+
+
+// C++ allocation functions
+
+namespace alloc_count::detail
+{
+    inline void *new_block(std::size_t size, std::size_t alignment = 0)
+    {
+        for (;;) {
+            auto *const p = alignment ? __libc_memalign(alignment, size) : __libc_malloc(size ? size : 1);
+            if (p) {
+                return allocated(p, size);
+            }
+            auto const handler = std::get_new_handler();
+            if (!handler) {
+                throw std::bad_alloc{};
+            }
+            handler();
+        }
+    }
+
+    inline void *new_block_nothrow(std::size_t size, std::size_t alignment = 0) noexcept
+    {
+        try {
+            return new_block(size, alignment);
+        } catch (...) {
+            return nullptr;
+        }
+    }
+
+    inline void delete_block(void *p) noexcept
+    {
+        freed(p);
+        __libc_free(p);
+    }
+}
+
+void *operator new(std::size_t size)
+{ return alloc_count::detail::new_block(size); }
+void *operator new[](std::size_t size)
+{ return alloc_count::detail::new_block(size); }
+void *operator new(std::size_t size, std::align_val_t a)
+{ return alloc_count::detail::new_block(size, static_cast<std::size_t>(a)); }
+void *operator new[](std::size_t size, std::align_val_t a)
+{ return alloc_count::detail::new_block(size, static_cast<std::size_t>(a)); }
+void *operator new(std::size_t size, const std::nothrow_t&) noexcept
+{ return alloc_count::detail::new_block_nothrow(size); }
+void *operator new[](std::size_t size, const std::nothrow_t&) noexcept
+{ return alloc_count::detail::new_block_nothrow(size); }
+void *operator new(std::size_t size, std::align_val_t a, const std::nothrow_t&) noexcept
+{ return alloc_count::detail::new_block_nothrow(size, static_cast<std::size_t>(a)); }
+void *operator new[](std::size_t size, std::align_val_t a, const std::nothrow_t&) noexcept
+{ return alloc_count::detail::new_block_nothrow(size, static_cast<std::size_t>(a)); }
+
+void operator delete(void *p) noexcept
+{ alloc_count::detail::delete_block(p); }
+void operator delete[](void *p) noexcept
+{ alloc_count::detail::delete_block(p); }
+void operator delete(void *p, std::size_t) noexcept
+{ alloc_count::detail::delete_block(p); }
+void operator delete[](void *p, std::size_t) noexcept
+{ alloc_count::detail::delete_block(p); }
+void operator delete(void *p, std::align_val_t) noexcept
+{ alloc_count::detail::delete_block(p); }
+void operator delete[](void *p, std::align_val_t) noexcept
+{ alloc_count::detail::delete_block(p); }
+void operator delete(void *p, std::size_t, std::align_val_t) noexcept
+{ alloc_count::detail::delete_block(p); }
+void operator delete[](void *p, std::size_t, std::align_val_t) noexcept
+{ alloc_count::detail::delete_block(p); }
+void operator delete(void *p, const std::nothrow_t&) noexcept
+{ alloc_count::detail::delete_block(p); }
+void operator delete[](void *p, const std::nothrow_t&) noexcept
+{ alloc_count::detail::delete_block(p); }
+void operator delete(void *p, std::align_val_t, const std::nothrow_t&) noexcept
+{ alloc_count::detail::delete_block(p); }
+void operator delete[](void *p, std::align_val_t, const std::nothrow_t&) noexcept
+{ alloc_count::detail::delete_block(p); }
+
+#endif // ALLOC_COUNT_HH
@@ -0,0 +1,2 @@
+alloc-count: alloc-count.hh
+USING_GTEST += alloc-count
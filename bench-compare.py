@@ -0,0 +1,104 @@
+#!/usr/bin/python3
+
+"""Compare two result files from bench, flagging significant changes.
+
+Usage: bench-compare.py [--alpha P] [--threshold FRACTION] BASELINE.json CURRENT.json
+
+For each benchmark present in both files, the samples are compared with a
+two-sided Mann-Whitney U test (which doesn't assume the timings are normally
+distributed).  A change is reported as a regression or improvement only if
+it is significant at level P (default 0.01) and the medians differ by more
+than FRACTION (default 0.05), so that noise and trivial shifts are ignored.
+
+The exit status is 1 if any benchmark regressed, else 0.
+"""
+
+import argparse
+import json
+import math
+import statistics
+import sys
+
+
+def mann_whitney_p(a, b):
+    """Two-sided p-value of the Mann-Whitney U test, by the normal
+    approximation with continuity and tie corrections."""
+    n1, n2 = len(a), len(b)
+    if n1 == 0 or n2 == 0:
+        return 1.0
+    combined = sorted((v, i) for i, v in enumerate(a + b))
+    ranks = [0.0] * (n1 + n2)
+    tie_term = 0
+    i = 0
+    while i < len(combined):
+        j = i
+        while j + 1 < len(combined) and combined[j + 1][0] == combined[i][0]:
+            j += 1
+        rank = (i + j) / 2 + 1
+        for k in range(i, j + 1):
+            ranks[combined[k][1]] = rank
+        t = j - i + 1
+        tie_term += t ** 3 - t
+        i = j + 1
+
+    u = sum(ranks[:n1]) - n1 * (n1 + 1) / 2
+    mean = n1 * n2 / 2
+    n = n1 + n2
+    variance = n1 * n2 / 12 * ((n + 1) - tie_term / (n * (n - 1)))
+    if variance <= 0:
+        return 1.0
+    z = (abs(u - mean) - 0.5) / math.sqrt(variance)
+    return min(1.0, math.erfc(max(z, 0) / math.sqrt(2)))
+
+
+def load(path):
+    with open(path) as f:
+        data = json.load(f)
+    return data.get('environment', {}), {b['name']: b for b in data['benchmarks']}
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument('--alpha', type=float, default=0.01)
+    parser.add_argument('--threshold', type=float, default=0.05)
+    parser.add_argument('baseline')
+    parser.add_argument('current')
+    args = parser.parse_args()
+
+    old_env, old = load(args.baseline)
+    new_env, new = load(args.current)
+
+    for key in sorted(set(old_env) | set(new_env)):
+        if key in ('date', 'host'):
+            continue
+        if old_env.get(key) != new_env.get(key):
+            print(f'warning: environment differs in {key}', file=sys.stderr)
+
+    print(f'{"benchmark":32} {"baseline":>12} {"current":>12} {"change":>8} {"p":>8}')
+    regressions = 0
+    for name in [n for n in new if n in old]:
+        a, b = old[name]['samples'], new[name]['samples']
+        before, after = statistics.median(a), statistics.median(b)
+        change = after / before - 1
+        p = mann_whitney_p(a, b)
+        verdict = ''
+        if p < args.alpha and abs(change) > args.threshold:
+            if change > 0:
+                verdict = 'REGRESSION'
+                regressions += 1
+            else:
+                verdict = 'improved'
+        print(f'{name:32} {before:12.1f} {after:12.1f} {change:+8.1%} {p:8.4f}  {verdict}')
+
+    for name in old:
+        if name not in new:
+            print(f'{name:32} (missing from {args.current})')
+    for name in new:
+        if name not in old:
+            print(f'{name:32} (new)')
+
+    return 1 if regressions else 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
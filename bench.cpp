@@ -0,0 +1,345 @@
+#include "caesar.hh"
+#include "median/median.hh"
+#include "thread-pool/pool.hh"
+#include "triple-buffer/buffer.hh"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <unistd.h>
+
+/*
+  Benchmarks of the median strategies, triple_buffer handoff and the Caesar kernels, with
+  machine-readable results for tracking performance over time.
+
+  Usage: bench [--json FILE] [--filter TEXT] [--samples N]
+
+  Each benchmark is timed as N samples (default 15), each a batch of repetitions running for at
+  least 20 ms; the time per operation of every sample is recorded.  A summary goes to standard
+  output; with --json, the samples and a description of the environment (CPU model and flags,
+  compiler and options) are written to FILE ("-" for standard output).  Only benchmarks whose
+  names contain TEXT are run.
+
+  Compare two result files with bench-compare.py, which tests whether differences are
+  significant.
+ */
+
+#ifndef BENCH_CXXFLAGS
+#define BENCH_CXXFLAGS ""
+#endif
+
+#if defined(__clang__)
+#define BENCH_COMPILER __VERSION__
+#elif defined(__GNUC__)
+#define BENCH_COMPILER "GCC " __VERSION__
+#else
+#define BENCH_COMPILER "unknown"
+#endif
+
+using clock_type = std::chrono::steady_clock;
+
+struct benchmark
+{
+    std::string name;
+    std::size_t bytes_per_op;   // 0 if throughput isn't meaningful
+    std::function<void()> op;
+};
+
+struct result
+{
+    std::string name;
+    std::size_t bytes_per_op;
+    std::vector<double> ns_per_op;
+};
+
+// Stops the compiler discarding results
+template<typename T>
+static void keep(T const& value)
+{
+    asm volatile("" : : "r,m"(value) : "memory");
+}
+
+static std::vector<double> sample(const benchmark& b, unsigned samples)
+{
+    constexpr auto min_sample_time = std::chrono::milliseconds{20};
+    b.op();                     // warm up
+    std::vector<double> times;
+    for (unsigned s = 0;  s < samples;  ++s) {
+        std::size_t reps = 0;
+        auto const start = clock_type::now();
+        auto end = start;
+        do {
+            b.op();
+            ++reps;
+            end = clock_type::now();
+        } while (end - start < min_sample_time);
+        times.push_back(std::chrono::duration<double, std::nano>(end - start).count()
+                        / static_cast<double>(reps));
+    }
+    return times;
+}
+
+static double median_of(std::vector<double> v)
+{
+    return stats::median.using_arithmetic_midpoint()(std::move(v));
+}
+
+
+// The benchmarks
+
+static std::vector<double> random_doubles(std::size_t n)
+{
+    std::mt19937 gen{1};
+    std::normal_distribution<double> dist;
+    std::vector<double> v(n);
+    std::ranges::generate(v, [&]{ return dist(gen); });
+    return v;
+}
+
+template<bool Modifies = false, typename Engine>
+static void add_median(std::vector<benchmark>& benchmarks, const std::string& strategy,
+                       Engine engine)
+{
+    for (std::size_t n: {1000, 100000}) {
+        auto const data = std::make_shared<const std::vector<double>>(random_doubles(n));
+        auto const scratch = std::make_shared<std::vector<double>>();
+        auto const name = "median/" + strategy + "/" + std::to_string(n);
+        if constexpr (Modifies) {
+            // includes the cost of restoring the input
+            benchmarks.push_back({name, n * sizeof (double), [=]{
+                *scratch = *data;
+                keep(engine(*scratch));
+            }});
+        } else {
+            benchmarks.push_back({name, n * sizeof (double), [=]{ keep(engine(*data)); }});
+        }
+    }
+}
+
+static void add_triple_buffer(std::vector<benchmark>& benchmarks)
+{
+    auto const buffer = std::make_shared<triple_buffer<std::array<char, 64>>>();
+    benchmarks.push_back({"triple_buffer/write", 0, [=]{
+        (*buffer->get_write_buffer())[0] = 'x';
+        buffer->set_write_complete();
+    }});
+    benchmarks.push_back({"triple_buffer/handoff", 0, [=]{
+        (*buffer->get_write_buffer())[0] = 'x';
+        buffer->set_write_complete();
+        keep(buffer->get_read_buffer({}));
+    }});
+    benchmarks.push_back({"triple_buffer/poll_empty", 0, [=]{
+        keep(buffer->get_read_buffer({}));
+    }});
+}
+
+static void add_caesar(std::vector<benchmark>& benchmarks)
+{
+    constexpr std::size_t size = 1 << 16;
+    constexpr int rotation = 13;
+    auto const text = std::make_shared<std::vector<char>>(size);
+    for (std::size_t i = 0;  i < size;  ++i) {
+        (*text)[i] = static_cast<char>(' ' + i * 7 % 95);
+    }
+    auto add = [&](const char *name, caesar_kernels::signature *kernel) {
+        benchmarks.push_back({std::string{"caesar/"} + name, size, [=]{
+            kernel(text->data(), text->data(), size, rotation);
+        }});
+    };
+    benchmarks.push_back({"caesar/caesar_rotator", size, [=]{
+        caesar_rotator{rotation}(text->data(), text->data(), size);
+    }});
+    add("table", caesar_kernels::table);
+    add("scalar", caesar_kernels::scalar);
+#if defined(__x86_64__) || defined(__i386__)
+    add("sse2", caesar_kernels::sse2);
+    if (__builtin_cpu_supports("avx2")) { add("avx2", caesar_kernels::avx2); }
+    if (__builtin_cpu_supports("avx512bw")) { add("avx512", caesar_kernels::avx512); }
+#endif
+}
+
+static std::vector<benchmark> all_benchmarks()
+{
+    std::vector<benchmark> benchmarks;
+    add_median(benchmarks, "default", stats::median);
+    add_median(benchmarks, "copy", stats::median.using_copy_strategy());
+    add_median(benchmarks, "external", stats::median.using_external_strategy());
+    add_median(benchmarks, "frugal", stats::median.using_frugal_strategy());
+    add_median(benchmarks, "bracket", stats::median.using_bracket_strategy());
+    add_median<true>(benchmarks, "inplace", stats::median.using_inplace_strategy());
+    static thread_pool pool;
+    add_median(benchmarks, "parallel", stats::median.using_executor(pool));
+    add_triple_buffer(benchmarks);
+    add_caesar(benchmarks);
+    return benchmarks;
+}
+
+
+// Environment and JSON output
+
+static std::string json_string(std::string_view s)
+{
+    std::string out = "\"";
+    for (char c: s) {
+        switch (c) {
+        case '"': out += "\\\""; break;
+        case '\\': out += "\\\\"; break;
+        case '\n': out += "\\n"; break;
+        case '\t': out += "\\t"; break;
+        default:
+            if (static_cast<unsigned char>(c) < 0x20) {
+                char escape[8];
+                std::snprintf(escape, sizeof escape, "\\u%04x", c);
+                out += escape;
+            } else {
+                out += c;
+            }
+        }
+    }
+    return out + '"';
+}
+
+// The value of the first "key : value" line of /proc/cpuinfo
+static std::string cpuinfo(std::string_view key)
+{
+    std::ifstream in{"/proc/cpuinfo"};
+    std::string line;
+    while (std::getline(in, line)) {
+        if (line.starts_with(key)) {
+            auto const colon = line.find(':');
+            if (colon != line.npos) {
+                auto const value = line.find_first_not_of(' ', colon + 1);
+                return value == line.npos ? "" : line.substr(value);
+            }
+        }
+    }
+    return "";
+}
+
+static std::string environment_json()
+{
+    char host[256] = "";
+    gethostname(host, sizeof host - 1);
+    auto const now = std::time(nullptr);
+    char date[32];
+    std::strftime(date, sizeof date, "%Y-%m-%dT%H:%M:%SZ", std::gmtime(&now));
+
+    std::ostringstream os;
+    os << "{\n"
+       << "    \"date\": " << json_string(date) << ",\n"
+       << "    \"host\": " << json_string(host) << ",\n"
+       << "    \"cpu\": " << json_string(cpuinfo("model name")) << ",\n"
+       << "    \"cpu_flags\": " << json_string(cpuinfo("flags")) << ",\n"
+       << "    \"cpus\": " << sysconf(_SC_NPROCESSORS_ONLN) << ",\n"
+       << "    \"compiler\": " << json_string(BENCH_COMPILER) << ",\n"
+       << "    \"cxxflags\": " << json_string(BENCH_CXXFLAGS) << "\n"
+       << "  }";
+    return os.str();
+}
+
+static void write_json(std::ostream& os, const std::vector<result>& results)
+{
+    os << "{\n  \"environment\": " << environment_json() << ",\n  \"benchmarks\": [";
+    const char *separator = "\n";
+    for (auto const& r: results) {
+        os << separator
+           << "    {\"name\": " << json_string(r.name)
+           << ", \"bytes_per_op\": " << r.bytes_per_op
+           << ", \"unit\": \"ns\", \"samples\": [";
+        for (std::size_t i = 0;  i < r.ns_per_op.size();  ++i) {
+            char number[32];
+            std::snprintf(number, sizeof number, "%.6g", r.ns_per_op[i]);
+            os << (i ? ", " : "") << number;
+        }
+        os << "]}";
+        separator = ",\n";
+    }
+    os << "\n  ]\n}\n";
+}
+
+
+int main(int argc, char **argv)
+{
+    std::string json_file;
+    std::string filter;
+    unsigned samples = 15;
+    try {
+        for (int i = 1;  i < argc;  ++i) {
+            std::string_view const arg = argv[i];
+            if (i + 1 == argc) {
+                throw std::invalid_argument("missing value");
+            }
+            if (arg == "--json") {
+                json_file = argv[++i];
+            } else if (arg == "--filter") {
+                filter = argv[++i];
+            } else if (arg == "--samples") {
+                samples = static_cast<unsigned>(std::stoul(argv[++i]));
+                if (!samples) {
+                    throw std::invalid_argument("no samples");
+                }
+            } else {
+                throw std::invalid_argument("unknown option");
+            }
+        }
+    } catch (std::logic_error&) {
+        std::cerr << "Usage: " << argv[0] << " [--json FILE] [--filter TEXT] [--samples N]\n";
+        return EXIT_FAILURE;
+    }
+
+    // Summary goes to stderr if JSON goes to stdout
+    auto *const summary = json_file == "-" ? stderr : stdout;
+    std::vector<result> results;
+    try {
+        std::fprintf(summary, "%-32s %12s %10s %12s\n", "benchmark", "ns/op", "±MAD %", "GB/s");
+        for (auto const& b: all_benchmarks()) {
+            if (b.name.find(filter) == std::string::npos) {
+                continue;
+            }
+            auto times = sample(b, samples);
+            auto const mid = median_of(times);
+            std::vector<double> deviations;
+            for (auto t: times) {
+                deviations.push_back(std::abs(t - mid));
+            }
+            auto const mad = median_of(std::move(deviations));
+            std::fprintf(summary, "%-32s %12.1f %10.2f", b.name.c_str(), mid, 100 * mad / mid);
+            if (b.bytes_per_op) {
+                std::fprintf(summary, " %12.3f", static_cast<double>(b.bytes_per_op) / mid);
+            }
+            std::fprintf(summary, "\n");
+            std::fflush(summary);
+            results.push_back({b.name, b.bytes_per_op, std::move(times)});
+        }
+
+        if (json_file == "-") {
+            write_json(std::cout, results);
+        } else if (!json_file.empty()) {
+            std::ofstream out{json_file};
+            write_json(out, results);
+            if (!out.flush()) {
+                throw std::runtime_error("failed writing " + json_file);
+            }
+        }
+    } catch (std::exception& e) {
+        std::cerr << argv[0] << ": " << e.what() << '\n';
+        return EXIT_FAILURE;
+    }
+}
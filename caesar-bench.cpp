@@ -0,0 +1,392 @@
+#include "caesar.hh"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <iterator>
+#include <limits>
+#include <memory>
+#include <new>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+/*
+  Throughput of the Caesar rotation kernels, and of complete filters using different I/O methods.
+
+  Usage: caesar-bench [MAX_BUFFER_BYTES [IO_BYTES]]
+
+  Kernels are timed in memory, on buffers from 64 bytes up to MAX_BUFFER_BYTES (default 1 GiB).
+  Sizes that can't be allocated are skipped.  A column of a million short strings is then rotated
+  as a whole and with per-string rotations.
+
+  Then a filter of IO_BYTES (default 64 MiB) is timed for each I/O method, both from file to file
+  and from pipe to pipe.  The splice method copies without rotating, and so is the ceiling for
+  any filter.
+
+  Cycles are reference (TSC) cycles, which may differ from core clock cycles.
+ */
+
+using clock_type = std::chrono::steady_clock;
+
+static std::uint64_t cycles()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+struct measurement
+{
+    double seconds;
+    std::uint64_t cycles;
+};
+
+// Best of several batches, each long enough to time reliably
+template<typename F>
+static measurement measure(F&& f, unsigned batches = 5)
+{
+    constexpr auto min_batch_time = std::chrono::milliseconds{20};
+    f();                        // warm up
+    measurement best{std::numeric_limits<double>::infinity(), 0};
+    for (unsigned b = 0;  b < batches;  ++b) {
+        unsigned reps = 0;
+        auto const start = clock_type::now();
+        auto const start_cycles = cycles();
+        auto end = start;
+        do {
+            f();
+            ++reps;
+            end = clock_type::now();
+        } while (end - start < min_batch_time);
+        auto const seconds = std::chrono::duration<double>(end - start).count() / reps;
+        if (seconds < best.seconds) {
+            best = {seconds, (cycles() - start_cycles) / reps};
+        }
+    }
+    return best;
+}
+
+static void report(const std::string& name, std::size_t bytes, measurement m)
+{
+    std::printf("%-28s %12zu  %8.3f GB/s  %7.3f cycles/byte\n",
+                name.c_str(), bytes, static_cast<double>(bytes) / m.seconds / 1e9,
+                static_cast<double>(m.cycles) / static_cast<double>(bytes));
+    std::fflush(stdout);
+}
+
+// Random printable ASCII, with the line lengths and letter density of prose
+static void fill_text(char *p, std::size_t n)
+{
+    constexpr std::size_t pattern_size = 1 << 16;
+    static auto const pattern = []{
+        std::string s(pattern_size, ' ');
+        std::mt19937 gen{1};
+        std::uniform_int_distribution<int> printable{' ', '~'};
+        std::uniform_int_distribution<int> letter{'a', 'z'};
+        std::uniform_int_distribution<int> percent{0, 99};
+        for (std::size_t i = 0;  i < s.size();  ++i) {
+            auto const r = percent(gen);
+            s[i] = static_cast<char>(r < 75 ? letter(gen) : r < 90 ? ' ' : r < 92 ? '\n' : printable(gen));
+        }
+        return s;
+    }();
+    for (std::size_t i = 0;  i < n;  i += pattern_size) {
+        std::memcpy(p + i, pattern.data(), std::min(pattern_size, n - i));
+    }
+}
+
+
+// In-memory kernels
+
+static void bench_kernels(std::size_t max_size)
+{
+    constexpr int rotation = 13;
+    struct kernel {
+        const char *name;
+        std::function<void(char *, std::size_t)> f;
+    };
+    std::vector<kernel> kernels = {
+        { "caesar_rotator", [](char *p, std::size_t n){ caesar_rotator{rotation}(p, p, n); } },
+        { "table", [](char *p, std::size_t n){ caesar_kernels::table(p, p, n, rotation); } },
+        { "scalar", [](char *p, std::size_t n){ caesar_kernels::scalar(p, p, n, rotation); } },
+    };
+#if defined(__x86_64__) || defined(__i386__)
+    kernels.push_back({ "sse2", [](char *p, std::size_t n){ caesar_kernels::sse2(p, p, n, rotation); } });
+    if (__builtin_cpu_supports("avx2")) {
+        kernels.push_back({ "avx2", [](char *p, std::size_t n){ caesar_kernels::avx2(p, p, n, rotation); } });
+    }
+    if (__builtin_cpu_supports("avx512bw")) {
+        kernels.push_back({ "avx512", [](char *p, std::size_t n){ caesar_kernels::avx512(p, p, n, rotation); } });
+    }
+#endif
+
+    std::printf("%-28s %12s  %13s  %18s\n", "kernel", "bytes", "throughput", "");
+    for (std::size_t size = 64;  size <= max_size;  size *= 4) {
+        std::unique_ptr<char[]> buffer;
+        try {
+            buffer.reset(new char[size]);
+        } catch (std::bad_alloc&) {
+            std::printf("(can't allocate %zu bytes; skipping larger sizes)\n", size);
+            break;
+        }
+        fill_text(buffer.get(), size);
+        for (auto const& k: kernels) {
+            auto const batches = size > (1u << 26) ? 2u : 5u;
+            report(k.name, size, measure([&]{ k.f(buffer.get(), size); }, batches));
+        }
+    }
+}
+
+
+// Columns of short strings
+
+static void bench_columns()
+{
+    constexpr std::size_t count = 1 << 20;
+    std::mt19937 gen{2};
+    std::uniform_int_distribution<std::int32_t> length{4, 20};
+    std::uniform_int_distribution<int> any_rotation{0, 25};
+
+    std::vector<std::int32_t> offsets{0};
+    for (std::size_t i = 0;  i < count;  ++i) {
+        offsets.push_back(offsets.back() + length(gen));
+    }
+    auto const bytes = static_cast<std::size_t>(offsets.back());
+    std::unique_ptr<char[]> buffer{new char[bytes]};
+    fill_text(buffer.get(), bytes);
+
+    std::vector<int> mixed(count), runs(count);
+    for (std::size_t i = 0;  i < count;  ++i) {
+        mixed[i] = any_rotation(gen);
+        runs[i] = i % 100 ? runs[i - 1] : any_rotation(gen);
+    }
+
+    auto *const p = buffer.get();
+    std::printf("\n%-28s %12s  %13s  (%zu strings)\n", "column", "bytes", "throughput", count);
+    report("per string", bytes, measure([&]{
+        for (std::size_t i = 0;  i < count;  ++i) {
+            caesar_rotator{13}(p + offsets[i], p + offsets[i], static_cast<std::size_t>(offsets[i + 1] - offsets[i]));
+        }
+    }));
+    report("single rotation", bytes, measure([&]{
+        caesar_rotate_column<std::int32_t>(offsets, p, p, 13);
+    }));
+    report("rotation runs of 100", bytes, measure([&]{
+        caesar_rotate_column<std::int32_t>(offsets, p, p, runs);
+    }));
+    report("mixed rotations", bytes, measure([&]{
+        caesar_rotate_column<std::int32_t>(offsets, p, p, mixed);
+    }));
+}
+
+
+// End-to-end I/O
+
+struct fd_pair
+{
+    int in;
+    int out;
+};
+
+static void write_all(int fd, const char *p, std::size_t n)
+{
+    while (n) {
+        auto const w = ::write(fd, p, n);
+        if (w <= 0) {
+            throw std::system_error{errno, std::generic_category(), "write"};
+        }
+        p += w;
+        n -= static_cast<std::size_t>(w);
+    }
+}
+
+// The original filter: a character at a time through stream iterators
+static void filter_iostream(fd_pair fds)
+{
+    std::ifstream in{"/dev/fd/" + std::to_string(fds.in), std::ios::binary};
+    std::ofstream out{"/dev/fd/" + std::to_string(fds.out), std::ios::binary};
+    std::transform(std::istreambuf_iterator<char>{in}, std::istreambuf_iterator<char>{},
+                   std::ostreambuf_iterator<char>{out}, caesar_rotator{13});
+}
+
+// read() and write() a block at a time, rotating in place
+static void filter_block(fd_pair fds)
+{
+    constexpr std::size_t block_size = 1 << 16;
+    static char buffer[block_size];
+    caesar_rotator const rotator{13};
+    for (;;) {
+        auto const n = ::read(fds.in, buffer, block_size);
+        if (n < 0) {
+            throw std::system_error{errno, std::generic_category(), "read"};
+        }
+        if (n == 0) {
+            return;
+        }
+        rotator(buffer, buffer, static_cast<std::size_t>(n));
+        write_all(fds.out, buffer, static_cast<std::size_t>(n));
+    }
+}
+
+// Map the input, and rotate from the mapping into a block for write()
+static void filter_mmap(fd_pair fds)
+{
+    constexpr std::size_t block_size = 1 << 16;
+    static char buffer[block_size];
+    auto const size = static_cast<std::size_t>(::lseek(fds.in, 0, SEEK_END));
+    if (!size) {
+        return;
+    }
+    auto *const map = static_cast<const char *>(::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fds.in, 0));
+    if (map == MAP_FAILED) {
+        throw std::system_error{errno, std::generic_category(), "mmap"};
+    }
+    ::madvise(const_cast<char *>(map), size, MADV_SEQUENTIAL);
+    caesar_rotator const rotator{13};
+    for (std::size_t i = 0;  i < size;  i += block_size) {
+        auto const n = std::min(block_size, size - i);
+        rotator(map + i, buffer, n);
+        write_all(fds.out, buffer, n);
+    }
+    ::munmap(const_cast<char *>(map), size);
+}
+
+// Copy only, through a pipe, with no rotation
+static void filter_splice(fd_pair fds)
+{
+    constexpr std::size_t chunk = 1 << 16;
+    int pipefd[2];
+    if (::pipe(pipefd)) {
+        throw std::system_error{errno, std::generic_category(), "pipe"};
+    }
+    for (;;) {
+        auto const n = ::splice(fds.in, nullptr, pipefd[1], nullptr, chunk, SPLICE_F_MOVE);
+        if (n <= 0) {
+            break;
+        }
+        for (auto left = n;  left > 0; ) {
+            auto const m = ::splice(pipefd[0], nullptr, fds.out, nullptr,
+                                    static_cast<std::size_t>(left), SPLICE_F_MOVE);
+            if (m <= 0) {
+                throw std::system_error{errno, std::generic_category(), "splice"};
+            }
+            left -= m;
+        }
+    }
+    ::close(pipefd[0]);
+    ::close(pipefd[1]);
+}
+
+// Run filter from one file to another
+static void run_files(void (*filter)(fd_pair), const std::filesystem::path& input,
+                      const std::filesystem::path& output)
+{
+    fd_pair const fds{::open(input.c_str(), O_RDONLY),
+                      ::open(output.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0600)};
+    if (fds.in < 0 || fds.out < 0) {
+        throw std::system_error{errno, std::generic_category(), "open"};
+    }
+    filter(fds);
+    ::close(fds.in);
+    ::close(fds.out);
+}
+
+// Run filter from a pipe fed with data to a pipe that's drained
+static void run_pipes(void (*filter)(fd_pair), const std::string& data)
+{
+    int in[2], out[2];
+    if (::pipe(in) || ::pipe(out)) {
+        throw std::system_error{errno, std::generic_category(), "pipe"};
+    }
+    std::thread feeder{[&]{ write_all(in[1], data.data(), data.size()); ::close(in[1]); }};
+    std::thread drainer{[&]{
+        static char sink[1 << 16];
+        while (::read(out[0], sink, sizeof sink) > 0) {}
+    }};
+    filter({in[0], out[1]});
+    ::close(out[1]);
+    feeder.join();
+    drainer.join();
+    ::close(in[0]);
+    ::close(out[0]);
+}
+
+static void bench_io(std::size_t size)
+{
+    std::string data(size, '\0');
+    fill_text(data.data(), data.size());
+
+    auto const dir = std::filesystem::temp_directory_path();
+    auto const input = dir / ("caesar-bench-in." + std::to_string(::getpid()));
+    auto const output = dir / ("caesar-bench-out." + std::to_string(::getpid()));
+    std::ofstream{input, std::ios::binary}.write(data.data(), static_cast<std::streamsize>(data.size()));
+
+    struct method {
+        const char *name;
+        void (*filter)(fd_pair);
+        bool needs_file;
+    };
+    method const methods[] = {
+        { "iostream", filter_iostream, false },
+        { "block", filter_block, false },
+        { "mmap", filter_mmap, true },
+        { "splice (copy only)", filter_splice, false },
+    };
+
+    std::printf("\n%-28s %12s  %13s  %18s\n", "I/O method", "bytes", "throughput", "");
+    for (auto const& m: methods) {
+        report(std::string{m.name} + ", files", size,
+               measure([&]{ run_files(m.filter, input, output); }, 3));
+        if (!m.needs_file) {
+            report(std::string{m.name} + ", pipes", size,
+                   measure([&]{ run_pipes(m.filter, data); }, 3));
+        }
+    }
+
+    std::filesystem::remove(input);
+    std::filesystem::remove(output);
+}
+
+
+int main(int argc, char **argv)
+{
+    std::size_t max_size = std::size_t{1} << 30;
+    std::size_t io_size = std::size_t{1} << 26;
+    try {
+        if (argc > 1) { max_size = std::stoull(argv[1]); }
+        if (argc > 2) { io_size = std::stoull(argv[2]); }
+        if (argc > 3) { throw std::invalid_argument(""); }
+    } catch (std::logic_error&) {
+        std::cerr << "Usage: " << argv[0] << " [MAX_BUFFER_BYTES [IO_BYTES]]\n";
+        return EXIT_FAILURE;
+    }
+
+    try {
+        bench_kernels(max_size);
+        bench_columns();
+        bench_io(io_size);
+    } catch (std::exception& e) {
+        std::cerr << argv[0] << ": " << e.what() << '\n';
+        return EXIT_FAILURE;
+    }
+}
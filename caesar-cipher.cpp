@@ -1,69 +1,196 @@
+#include "caesar.hh"
+#include "thread-pool/pool.hh"
+#include "trace/trace.hh"
+
 #include <algorithm>
 #include <array>
-#include <cctype>
-#include <climits>
+#include <charconv>
 #include <cstdlib>
 #include <cstring>
 #include <iostream>
-#include <iterator>
-#include <numeric>
+#include <limits>
 #include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Guesses the rotation of enciphered English text, by comparing its
+// letter frequencies against those of English.
+class caesar_cracker {
+    static constexpr int letters = 26;
+
+    // Relative frequencies of a-z in typical English text.
+    static constexpr std::array<double, letters> english = {
+        .08167, .01492, .02782, .04253, .12702, .02228, .02015, .06094, .06966,
+        .00153, .00772, .04025, .02406, .06749, .07507, .01929, .00095, .05987,
+        .06327, .09056, .02758, .00978, .02360, .00150, .01974, .00074,
+    };
+
+    // Bins 0-25 count letters; everything else falls into bin 26.
+    static constexpr unsigned char other = letters;
+    using histogram = std::array<std::size_t, 32>;
+
+    // Successive bytes increment different sub-histograms, so that runs
+    // of a repeated letter don't stall waiting on the previous store to
+    // the same counter.
+    static constexpr std::size_t ways = 4;
+    std::array<histogram, ways> counts = {};
 
-class caesar_rotator {
-    using char_table = std::array<char, UCHAR_MAX+1>;
-    const char_table table;
+    // Classification is done a vector at a time into this block,
+    // which is then counted.
+    using byte_vector = unsigned char __attribute__((vector_size(16)));
+    static constexpr std::size_t block_size = 256;
+    static_assert(block_size % sizeof (byte_vector) == 0);
+    static_assert(sizeof (byte_vector) % ways == 0);
 
 public:
-    caesar_rotator(int rotation) noexcept
-        : table{create_table(rotation)}
-    {}
+    void add(const char *first, const char *last) noexcept
+    {
+        alignas(byte_vector) unsigned char bins[block_size];
+        while (first != last) {
+            auto const n = std::min(block_size, static_cast<std::size_t>(last - first));
+            if (n == block_size) {
+                for (std::size_t i = 0;  i < block_size;  i += sizeof (byte_vector)) {
+                    byte_vector v;
+                    std::memcpy(&v, first + i, sizeof v);
+                    // fold to lower case, then offset from 'a' (wrapping)
+                    v = (v | 0x20) - 'a';
+                    byte_vector const is_letter = v < letters;
+                    v = (v & is_letter) | (other & ~is_letter);
+                    std::memcpy(bins + i, &v, sizeof v);
+                }
+            } else {
+                std::transform(first, first + n, bins, bin_of);
+            }
+            std::size_t i = 0;
+            for (;  i + ways <= n;  i += ways) {
+                for (std::size_t w = 0;  w < ways;  ++w) {
+                    ++counts[w][bins[i + w]];
+                }
+            }
+            for (;  i < n;  ++i) {
+                ++counts[0][bins[i]];
+            }
+            first += n;
+        }
+    }
 
-    char operator()(char c) const noexcept
+    // The rotation that most plausibly produced the text seen so far.
+    int rotation() const noexcept
     {
-        return table[static_cast<unsigned char>(c)];
-    };
+        std::array<double, letters> c;
+        for (auto i = 0;  i < letters;  ++i) {
+            c[i] = 0;
+            for (auto const& h: counts) {
+                c[i] += static_cast<double>(h[i]);
+            }
+        }
+
+        // For rotation r with N letters, Pearson's chi-squared statistic is
+        //     Σ (c[i+r] - N e[i])² / N e[i]  =  Σ c[i+r]² / N e[i]  -  N
+        // so we need only minimise Σ c[i+r]² / e[i], without
+        // re-counting the decoded text.
+        int best = 0;
+        auto best_score = std::numeric_limits<double>::infinity();
+        for (auto r = 0;  r < letters;  ++r) {
+            double score = 0;
+            for (auto i = 0;  i < letters;  ++i) {
+                auto const n = c[(i + r) % letters];
+                score += n * n / english[i];
+            }
+            if (score < best_score) {
+                best = r;
+                best_score = score;
+            }
+        }
+        return best;
+    }
 
 private:
-    static constexpr int upper_int(char c)
+    static unsigned char bin_of(char c) noexcept
     {
-        return std::toupper(static_cast<unsigned char>(c));
+        auto const i = (static_cast<unsigned char>(c) | 0x20) - 'a';
+        return i >= 0 && i < letters ? static_cast<unsigned char>(i) : other;
     }
-    static constexpr char upper_char(char c)
-    {
-        return static_cast<char>(upper_int(c));
+};
+
+
+// Read from buf until limit bytes or end of input.
+static std::string read_up_to(std::streambuf& buf, std::size_t limit)
+{
+    std::string s;
+    std::size_t chunk = 1 << 16;
+    while (s.size() < limit) {
+        auto const old_size = s.size();
+        auto const want = std::min(chunk, limit - old_size);
+        s.resize(old_size + want);
+        auto const got = static_cast<std::size_t>(buf.sgetn(s.data() + old_size,
+                                                             static_cast<std::streamsize>(want)));
+        s.resize(old_size + got);
+        if (got < want) {
+            break;
+        }
+        chunk *= 2;
     }
+    return s;
+}
 
-    static char_table create_table(int rotation)
-    {
-        constexpr auto* letters = "abcdefghijklmnopqrstuvwxyz";
-        constexpr int len = std::strlen(letters);
-
-        // normalise to the smallest positive equivalent
-        rotation = (rotation % len + len) % len;
-
-        char_table table;
-        // begin with a identity mapping
-        std::iota(table.begin(), table.end(), 0);
-        // change the mapping of letters
-        for (auto i = 0, target = rotation;  i < len;  ++i, ++target) {
-            if (target == len) {
-                target = 0;
-            }
-            table[letters[i]] = letters[target];
-            table[upper_int(letters[i])] = upper_char(letters[target]);
+// Read up to limit characters, waiting only until some are available
+// (so that interactive and piped input is filtered as it arrives).
+// Returns zero at end of input.
+static std::size_t read_some(std::streambuf& buf, char *s, std::size_t limit)
+{
+    using traits = std::streambuf::traits_type;
+    if (traits::eq_int_type(buf.sgetc(), traits::eof())) {
+        return 0;
+    }
+    std::size_t n = 0;
+    while (n < limit) {
+        auto const available = buf.in_avail();
+        if (available <= 0) {
+            break;
         }
-        return table;
+        auto const want = std::min(static_cast<std::size_t>(available), limit - n);
+        n += static_cast<std::size_t>(buf.sgetn(s + n, static_cast<std::streamsize>(want)));
     }
-};
+    return n;
+}
 
 
 int main(int argc, char **argv)
 {
     constexpr int default_rotation = 13;
+    constexpr std::string_view crack_option = "--crack";
+    auto const *const progname = argv[0];
     // Parse arguments
+    bool utf8 = false;
+    if (argc > 1 && std::string_view{argv[1]} == "--utf8") {
+        utf8 = true;
+        --argc;
+        ++argv;
+    }
     int rotation;
+    bool crack = false;
+    std::size_t sample_size = std::numeric_limits<std::size_t>::max();
     if (argc <= 1) {
         rotation = default_rotation;
+    } else if (argc == 2 && std::string_view{argv[1]}.starts_with(crack_option)) {
+        crack = true;
+        rotation = 0;
+        auto const arg = std::string_view{argv[1]}.substr(crack_option.size());
+        if (arg.starts_with('=')) {
+            // from_chars() rejects signs and whitespace, and values too large for size_t
+            auto const digits = arg.substr(1);
+            auto const last = digits.data() + digits.size();
+            auto const [end, error] = std::from_chars(digits.data(), last, sample_size);
+            if (error != std::errc{} || end != last || !sample_size) {
+                std::cerr << "Invalid sample size: " << digits << " (positive integer required)\n";
+                return EXIT_FAILURE;
+            }
+        } else if (!arg.empty()) {
+            std::cerr << "Unknown option: " << argv[1] << '\n';
+            return EXIT_FAILURE;
+        }
     } else if (argc == 2) {
         try {
             std::size_t end;
@@ -74,15 +201,65 @@ int main(int argc, char **argv)
             return EXIT_FAILURE;
         }
     } else {
-        std::cerr << "Usage: " << argv[0]
-                  << " [NUMBER]\nCaesar-shift letters in standard input by NUMBER places (default "
-                  << default_rotation <<")\n";
+        std::cerr << "Usage: " << progname
+                  << " [--utf8] [NUMBER]\nCaesar-shift letters in standard input by NUMBER places (default "
+                  << default_rotation <<")\n"
+                  << "   or: " << progname
+                  << " [--utf8] --crack[=BYTES]\nGuess the shift from letter frequencies of the first BYTES"
+                  << " of input (default all), and undo it\n"
+                  << "With --utf8, accented Latin-1 letters are replaced by their base letters and shifted\n";
         return EXIT_FAILURE;
     }
 
-    // Now filter the input
-    std::transform(std::istreambuf_iterator<char>{std::cin},
-                   std::istreambuf_iterator<char>{},
-                   std::ostreambuf_iterator<char>{std::cout},
-                   caesar_rotator{rotation});
+    // Unsynchronised streams can tell us how much input is ready
+    std::ios::sync_with_stdio(false);
+    auto& in = *std::cin.rdbuf();
+    auto& out = *std::cout.rdbuf();
+    // UTF-8 rotation is sequential; plain rotation shares whatever input
+    // is ready across a thread pool, with room for a block per thread.
+    constexpr std::size_t block_size = 1 << 16;
+    thread_pool pool{utf8 ? 0 : thread_pool::default_workers()};
+    auto const read_size = block_size * (utf8 ? 1 : std::min<std::size_t>(pool.concurrency(), 64));
+
+    // Filled in once we know the rotation
+    caesar_rotator rotator{rotation};
+    caesar_utf8_rotator utf8_rotator{rotation};
+    std::array<char, block_size + 1> utf8_buffer;
+    auto const process = [&](char *data, std::size_t n) {
+        TRACE_SCOPE("caesar-cipher block");
+        if (utf8) {
+            auto const m = utf8_rotator(data, utf8_buffer.data(), n);
+            out.sputn(utf8_buffer.data(), static_cast<std::streamsize>(m));
+        } else {
+            rotator(pool, data, data, n);
+            out.sputn(data, static_cast<std::streamsize>(n));
+        }
+    };
+
+    if (crack) {
+        // Sample the input, decide the shift, and decode the sample
+        auto sample = read_up_to(in, sample_size);
+        caesar_cracker cracker;
+        cracker.add(sample.data(), sample.data() + sample.size());
+        auto const shift = cracker.rotation();
+        std::clog << progname << ": detected shift " << shift << '\n';
+        rotator = caesar_rotator{-shift};
+        utf8_rotator = caesar_utf8_rotator{-shift};
+        for (std::size_t i = 0;  i < sample.size();  i += read_size) {
+            process(sample.data() + i, std::min(read_size, sample.size() - i));
+        }
+    }
+
+    // Now filter the (rest of the) input as it arrives, a block at a time
+    std::vector<char> buffer(read_size);
+    while (auto const n = read_some(in, buffer.data(), buffer.size())) {
+        process(buffer.data(), n);
+        out.pubsync();
+    }
+    if (utf8) {
+        auto const m = utf8_rotator.finish(utf8_buffer.data());
+        out.sputn(utf8_buffer.data(), static_cast<std::streamsize>(m));
+    }
+    // in a tracing build, report the block timings
+    TRACE_DUMP(std::clog);
 }
@@ -0,0 +1,354 @@
+#include "caesar.hh"
+#include "thread-pool/pool.hh"
+
+#include <gtest/gtest.h>
+#include "alloc-count/alloc-count.hh"
+
+#include <cstdint>
+#include <forward_list>
+#include <istream>
+#include <iterator>
+#include <ostream>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+static std::string rotated(std::string s, int rotation)
+{
+    for (auto& c: s) {
+        c = caesar_rotator{rotation}(c);
+    }
+    return s;
+}
+
+// Some text longer than the small buffers used in these tests
+static const std::string plain =
+    "The quick brown fox jumps over the lazy dog.\n"
+    "PACK MY BOX WITH FIVE DOZEN LIQUOR JUGS!\n"
+    "\t0123456789 @[`{ \x7f\x80\xe9\xff\n";
+
+
+TEST(caesar_rotator, characters)
+{
+    EXPECT_EQ(caesar_rotator{1}('a'), 'b');
+    EXPECT_EQ(caesar_rotator{1}('z'), 'a');
+    EXPECT_EQ(caesar_rotator{1}('Z'), 'A');
+    EXPECT_EQ(caesar_rotator{-1}('a'), 'z');
+    EXPECT_EQ(caesar_rotator{27}('a'), 'b');
+    EXPECT_EQ(caesar_rotator{13}('@'), '@');
+    EXPECT_EQ(caesar_rotator{13}('['), '[');
+    EXPECT_EQ(caesar_rotator{13}('\xe1'), '\xe1');
+}
+
+TEST(caesar_rotator, block_matches_table)
+{
+    std::string all(256, '\0');
+    for (int i = 0;  i < 256;  ++i) {
+        all[static_cast<std::size_t>(i)] = static_cast<char>(i);
+    }
+    for (int r = -26;  r <= 26;  ++r) {
+        std::string out(all.size(), '\0');
+        caesar_rotator{r}(all.data(), out.data(), all.size());
+        EXPECT_EQ(out, rotated(all, r)) << "rotation " << r;
+    }
+}
+
+TEST(caesar_rotator, on_thread_pool)
+{
+    thread_pool pool{3};
+    // more than a chunk per thread, not evenly divisible
+    std::string in;
+    while (in.size() < 5 * caesar_rotator::min_chunk + 100) {
+        in += plain;
+    }
+    std::string out(in.size(), '\0');
+    caesar_rotator{13}(pool, in.data(), out.data(), in.size());
+    EXPECT_EQ(out, rotated(in, 13));
+    // in place
+    caesar_rotator{13}(pool, out.data(), out.data(), out.size());
+    EXPECT_EQ(out, in);
+    // less than a chunk
+    out.assign(100, '\0');
+    caesar_rotator{13}(pool, in.data(), out.data(), out.size());
+    EXPECT_EQ(out, rotated(in.substr(0, out.size()), 13));
+    caesar_rotator{13}(pool, in.data(), out.data(), 0);
+}
+
+TEST(caesar_rotator, transforms_do_not_allocate)
+{
+    std::string in;
+    while (in.size() < 10000) {
+        in += plain;
+    }
+    std::string out(in.size() + 1, '\0');
+    caesar_rotator const rotator{13};
+    caesar_utf8_rotator utf8{13};
+    EXPECT_NO_ALLOC(rotator(in.data(), out.data(), in.size()));
+    EXPECT_NO_ALLOC(rotator(out.data(), out.data(), in.size()));
+    EXPECT_NO_ALLOC(utf8(in.data(), out.data(), in.size()));
+
+    std::vector<std::int32_t> const offsets{0, 10, 10, 5000, 9000};
+    EXPECT_NO_ALLOC(caesar_rotate_column<std::int32_t>(offsets, in.data(), out.data(), 11));
+}
+
+TEST(caesar_kernels, match_table)
+{
+    std::string in;
+    for (int i = 0;  i < 1000;  ++i) {
+        in += static_cast<char>(i * 7);
+    }
+    for (int r: {-1, 0, 1, 13, 25, 26, 40}) {
+        auto const expected = rotated(in, r);
+        auto test = [&](auto kernel, const char *name) {
+            std::string out(in.size(), '\0');
+            kernel(in.data(), out.data(), in.size(), r);
+            EXPECT_EQ(out, expected) << name << " rotation " << r;
+        };
+        test(caesar_kernels::table, "table");
+        test(caesar_kernels::scalar, "scalar");
+        test(caesar_kernels::vector<8>, "vector<8>");
+#if defined(__x86_64__) || defined(__i386__)
+        test(caesar_kernels::sse2, "sse2");
+        if (__builtin_cpu_supports("avx2")) { test(caesar_kernels::avx2, "avx2"); }
+        if (__builtin_cpu_supports("avx512bw")) { test(caesar_kernels::avx512, "avx512"); }
+#endif
+    }
+}
+
+TEST(caesar_streambuf, read)
+{
+    for (std::size_t size: {1, 7, 64, 1024}) {
+        std::istringstream source{plain};
+        caesar_streambuf buf{source.rdbuf(), 3, size};
+        std::istream in{&buf};
+        std::string line, result;
+        while (std::getline(in, line)) {
+            result += line + '\n';
+        }
+        EXPECT_EQ(result, rotated(plain, 3)) << "buffer size " << size;
+    }
+}
+
+TEST(caesar_streambuf, bulk_read)
+{
+    std::istringstream source{plain};
+    caesar_streambuf buf{source.rdbuf(), 5, 8};
+    // a single character through the get area, then a read bigger than the buffer
+    std::string result(plain.size() + 10, '\0');
+    result[0] = static_cast<char>(buf.sbumpc());
+    auto const n = buf.sgetn(result.data() + 1, static_cast<std::streamsize>(result.size() - 1));
+    ASSERT_EQ(n + 1, plain.size());
+    result.resize(plain.size());
+    EXPECT_EQ(result, rotated(plain, 5));
+    EXPECT_EQ(buf.sgetc(), std::char_traits<char>::eof());
+}
+
+TEST(caesar_streambuf, write)
+{
+    for (std::size_t size: {1, 7, 64, 1024}) {
+        std::ostringstream sink;
+        {
+            caesar_streambuf buf{sink.rdbuf(), 3, size};
+            std::ostream out{&buf};
+            for (auto c: plain) {
+                out.put(c);
+            }
+        } // flushed here
+        EXPECT_EQ(sink.str(), rotated(plain, 3)) << "buffer size " << size;
+    }
+}
+
+TEST(caesar_streambuf, bulk_write)
+{
+    std::ostringstream sink;
+    caesar_streambuf buf{sink.rdbuf(), -3, 8};
+    EXPECT_EQ(buf.sputn(plain.data(), 0), 0);   // before there's a put area
+    buf.sputc(plain[0]);
+    buf.sputn(plain.data() + 1, 3);   // fits in buffer
+    buf.sputn(plain.data() + 4, static_cast<std::streamsize>(plain.size() - 4));
+    EXPECT_EQ(buf.pubsync(), 0);
+    EXPECT_EQ(sink.str(), rotated(plain, -3));
+}
+
+TEST(caesar_streambuf, round_trip)
+{
+    std::stringstream s;
+    {
+        caesar_streambuf encode{s.rdbuf(), 13};
+        std::ostream{&encode} << plain;
+    }
+    EXPECT_EQ(s.str(), rotated(plain, 13));
+
+    caesar_streambuf decode{s.rdbuf(), 13};
+    std::ostringstream result;
+    result << &decode;
+    EXPECT_EQ(result.str(), plain);
+}
+
+TEST(caesar_view, elements)
+{
+    std::string_view const text = "Hello, World!";
+    auto view = text | views::caesar(13);
+    EXPECT_EQ(std::string(view.begin(), view.end()), "Uryyb, Jbeyq!");
+    EXPECT_EQ(view.size(), text.size());
+    EXPECT_EQ(view[1], 'r');
+}
+
+TEST(caesar_view, composes)
+{
+    std::string_view const text = "abcdef";
+    auto view = text | std::views::reverse | views::caesar(1) | std::views::take(3);
+    EXPECT_EQ(std::string(view.begin(), view.end()), "gfe");
+    auto filtered = views::caesar(text | std::views::filter([](char c){ return c != 'c'; }), -1);
+    EXPECT_EQ(std::string(filtered.begin(), filtered.end()), "zacde");
+}
+
+TEST(caesar_view, copy)
+{
+    auto const view = plain | views::caesar(7);
+    auto const expected = rotated(plain, 7);
+    {
+        SCOPED_TRACE("contiguous\n");
+        std::string out(plain.size(), '\0');
+        EXPECT_EQ(view.copy(out.begin()), out.end());
+        EXPECT_EQ(out, expected);
+    }
+    {
+        SCOPED_TRACE("owning view\n");
+        std::vector<char> out(plain.size());
+        (std::string{plain} | views::caesar(7)).copy(out.begin());
+        EXPECT_EQ(std::string(out.begin(), out.end()), expected);
+    }
+    {
+        SCOPED_TRACE("non-contiguous output\n");
+        std::string out;
+        view.copy(std::back_inserter(out));
+        EXPECT_EQ(out, expected);
+    }
+    {
+        SCOPED_TRACE("non-contiguous input\n");
+        std::forward_list<char> const input(plain.begin(), plain.end());
+        std::vector<char> out(plain.size());
+        (input | views::caesar(7)).copy(out.data());
+        EXPECT_EQ(std::string(out.begin(), out.end()), expected);
+    }
+}
+
+TEST(caesar_utf8_rotator, ascii)
+{
+    caesar_utf8_rotator rotator{3};
+    std::string out(plain.size() + 1, '\0');
+    auto const ascii = plain.substr(0, plain.find('\x80'));
+    out.resize(rotator(ascii.data(), out.data(), ascii.size()));
+    EXPECT_EQ(out, rotated(ascii, 3));
+}
+
+TEST(caesar_utf8_rotator, latin1)
+{
+    caesar_utf8_rotator rotator{1};
+    std::string_view const in = "Caf\u00e9 Stra\u00dfe \u00c6on \u00d7\u00f7 \u20ac \u00e9t\u00e9 longer than sixteen \u00ff";
+    std::string out(in.size() + 1, '\0');
+    out.resize(rotator(in.data(), out.data(), in.size()));
+    EXPECT_EQ(out, "Dbgf Tusbttf BFpo \u00d7\u00f7 \u20ac fuf mpohfs uibo tjyuffo z");
+}
+
+TEST(caesar_utf8_rotator, split_sequence)
+{
+    std::string_view const in = "x\u00e9y\xc3";
+    for (std::size_t split = 0;  split <= in.size();  ++split) {
+        caesar_utf8_rotator rotator{1};
+        std::string out(in.size() + 2, '\0');
+        auto n = rotator(in.data(), out.data(), split);
+        n += rotator(in.data() + split, out.data() + n, in.size() - split);
+        n += rotator.finish(out.data() + n);
+        out.resize(n);
+        EXPECT_EQ(out, "yfz\xc3") << "split at " << split;
+    }
+}
+
+// A column of strings: offsets and bytes, with a prefix that isn't part of it
+struct column
+{
+    std::vector<std::int64_t> offsets;
+    std::string bytes;
+
+    column(const std::vector<std::string>& strings, std::size_t prefix)
+        : offsets{static_cast<std::int64_t>(prefix)},
+          bytes(prefix, 'q')
+    {
+        for (auto const& s: strings) {
+            bytes += s;
+            offsets.push_back(static_cast<std::int64_t>(bytes.size()));
+        }
+        bytes += "trailer";
+    }
+
+    std::string string(std::size_t i, const std::string& b) const
+    {
+        auto const first = static_cast<std::size_t>(offsets[i]);
+        return b.substr(first, static_cast<std::size_t>(offsets[i + 1]) - first);
+    }
+};
+
+static std::vector<std::string> column_strings(std::size_t count)
+{
+    std::vector<std::string> strings;
+    for (std::size_t i = 0;  i < count;  ++i) {
+        // lengths from 0 to 99, so some runs are long
+        auto const length = i * 37 % 100;
+        strings.push_back(plain.substr(i % plain.size() / 2, length));
+    }
+    return strings;
+}
+
+TEST(caesar_rotate_column, single_rotation)
+{
+    auto const strings = column_strings(50);
+    column const c{strings, 3};
+    std::string out = c.bytes;
+    caesar_rotate_column<std::int64_t>(c.offsets, c.bytes.data(), out.data(), 11);
+    for (std::size_t i = 0;  i < strings.size();  ++i) {
+        EXPECT_EQ(c.string(i, out), rotated(strings[i], 11)) << "string " << i;
+    }
+    EXPECT_EQ(out.substr(0, 3), "qqq");
+    EXPECT_TRUE(out.ends_with("trailer"));
+}
+
+TEST(caesar_rotate_column, per_string_rotation)
+{
+    auto const strings = column_strings(300);
+    column const c{strings, 5};
+    std::vector<int> rotations;
+    for (std::size_t i = 0;  i < strings.size();  ++i) {
+        // some runs of equal (or equivalent) rotations
+        rotations.push_back(i % 7 < 3 ? 4 : static_cast<int>(i % 5) * 27);
+    }
+
+    std::string out = c.bytes;
+    caesar_rotate_column<std::int64_t>(c.offsets, c.bytes.data(), out.data(), rotations);
+    std::string inplace = c.bytes;
+    caesar_rotate_column<std::int64_t>(c.offsets, inplace.data(), inplace.data(), rotations);
+    EXPECT_EQ(inplace, out);
+    for (std::size_t i = 0;  i < strings.size();  ++i) {
+        EXPECT_EQ(c.string(i, out), rotated(strings[i], rotations[i])) << "string " << i;
+    }
+    EXPECT_EQ(out.substr(0, 5), "qqqqq");
+    EXPECT_TRUE(out.ends_with("trailer"));
+}
+
+TEST(caesar_rotate_column, edge_cases)
+{
+    std::string bytes = "abc";
+    std::vector<std::int32_t> const none{};
+    std::vector<std::int32_t> const empty{0};
+    caesar_rotate_column<std::int32_t>(none, bytes.data(), bytes.data(), 1);
+    caesar_rotate_column<std::int32_t>(empty, bytes.data(), bytes.data(), std::span<const int>{});
+    EXPECT_EQ(bytes, "abc");
+
+    std::vector<std::int32_t> const two{0, 1, 3};
+    EXPECT_THROW(caesar_rotate_column<std::int32_t>(two, bytes.data(), bytes.data(), std::vector{1}),
+                 std::invalid_argument);
+    caesar_rotate_column<std::int32_t>(two, bytes.data(), bytes.data(), std::vector{1, 2});
+    EXPECT_EQ(bytes, "bde");
+}
@@ -0,0 +1,737 @@
+#ifndef CAESAR_H
+#define CAESAR_H
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <climits>
+#include <concepts>
+#include <cstring>
+#include <iterator>
+#include <memory>
+#include <ranges>
+#include <span>
+#include <stdexcept>
+#include <streambuf>
+#include <utility>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+/*
+  Caesar-shift (rot-N) letters of ASCII text, leaving other characters unchanged.
+
+  * caesar_rotator{13}(c)               // rotate a single character
+
+  * caesar_rotator{13}(in, out, n)      // rotate a block (in may equal out)
+    caesar_rotator{13}(pool, in, out, n)    // the same, in chunks on a thread pool
+
+  * caesar_utf8_rotator{13}(in, out, n) // rotate UTF-8 text, folding accented Latin-1 letters
+
+  * caesar_rotate_column(offsets, in, out, 13)          // rotate a column of strings
+    caesar_rotate_column(offsets, in, out, rotations)   // each string with its own rotation
+
+  * caesar_streambuf buf{std::cout.rdbuf(), 13};
+    std::ostream os{&buf};              // everything written via os is rotated
+
+  * text | views::caesar(13)            // lazily rotated view of text
+    (text | views::caesar(13)).copy(out)    // bulk copy, using the block kernel where possible
+
+  The rotator is cheap to construct and copy: translation tables and specialised block kernels for
+  all 26 rotations are built at compile time.
+ */
+
+class caesar_rotator {
+public:
+    static constexpr int letters = 26;
+
+private:
+    using char_table = std::array<char, UCHAR_MAX+1>;
+    using block_kernel = void (*)(const char *, char *, std::size_t) noexcept;
+
+    // Tables and kernels for every rotation are built at compile time
+    // (defined below), so construction is just normalising the rotation.
+    static const std::array<char_table, letters> tables;
+    static const std::array<block_kernel, letters> kernels;
+
+    int rotation;
+
+public:
+    constexpr caesar_rotator(int rotation) noexcept
+        : rotation{normalise(rotation)}
+    {}
+
+    constexpr char operator()(char c) const noexcept
+    {
+        return tables[rotation][static_cast<unsigned char>(c)];
+    };
+
+    // Rotate n characters from in to out (which may be the same
+    // buffer, but must not otherwise overlap).  This dispatches once to
+    // a loop specialised for the rotation, which the compiler can
+    // vectorise with the shift as an immediate operand.
+    void operator()(const char *in, char *out, std::size_t n) const noexcept
+    {
+        kernels[rotation](in, out, n);
+    }
+
+    // Rotate a block in parallel on an executor such as thread_pool,
+    // split evenly across its threads in chunks of at least min_chunk
+    // characters (smaller blocks are rotated by the calling thread).
+    static constexpr std::size_t min_chunk = 1 << 16;
+
+    template<typename Executor>
+    void operator()(Executor& executor, const char *in, char *out, std::size_t n) const
+        requires requires(void (&body)(std::size_t, std::size_t)) {
+            executor.parallel_for(std::size_t{}, body, std::size_t{});
+            { executor.concurrency() } -> std::convertible_to<std::size_t>;
+        }
+    {
+        auto const kernel = kernels[rotation];
+        auto const chunks = std::max(std::min(n / min_chunk, std::size_t{executor.concurrency()}),
+                                     std::size_t{1});
+        auto const chunk = (n + chunks - 1) / chunks;
+        executor.parallel_for(chunks, [=](std::size_t first, std::size_t last) {
+            auto const begin = std::min(first * chunk, n);
+            auto const end = std::min(last * chunk, n);
+            kernel(in + begin, out + begin, end - begin);
+        }, 1);
+    }
+
+    static constexpr int normalise(int rotation) noexcept
+    {
+        // normalise to the smallest positive equivalent
+        return (rotation % letters + letters) % letters;
+    }
+
+    // Plain ASCII arithmetic, so this is independent of locale
+    // and can be evaluated at compile time.
+    // The rotation must already be normalised.
+    static constexpr char rotate(char c, int rotation) noexcept
+    {
+        auto const u = static_cast<unsigned char>(c);
+        // fold to lower case, then offset from 'a' (wrapping)
+        auto const offset = static_cast<unsigned char>((u | 0x20) - 'a');
+        // written without branches, to help the vectoriser
+        auto const shift = offset >= letters ? 0
+            : offset < letters - rotation ? rotation
+            : rotation - letters;
+        return static_cast<char>(u + shift);
+    }
+
+private:
+    template<int Rotation>
+    static void rotate_block(const char *in, char *out, std::size_t n) noexcept
+    {
+        for (std::size_t i = 0;  i < n;  ++i) {
+            out[i] = rotate(in[i], Rotation);
+        }
+    }
+
+    static constexpr char_table create_table(int rotation) noexcept
+    {
+        char_table table;
+        for (std::size_t c = 0;  c < table.size();  ++c) {
+            table[c] = rotate(static_cast<char>(c), rotation);
+        }
+        return table;
+    }
+
+    template<std::size_t... Rotation>
+    static constexpr auto create_tables(std::index_sequence<Rotation...>) noexcept
+    {
+        return std::array<char_table, letters>{create_table(Rotation)...};
+    }
+
+    template<std::size_t... Rotation>
+    static constexpr auto create_kernels(std::index_sequence<Rotation...>) noexcept
+    {
+        return std::array<block_kernel, letters>{&rotate_block<Rotation>...};
+    }
+};
+
+inline constexpr std::array<caesar_rotator::char_table, caesar_rotator::letters>
+caesar_rotator::tables = create_tables(std::make_index_sequence<letters>{});
+
+inline constexpr std::array<caesar_rotator::block_kernel, caesar_rotator::letters>
+caesar_rotator::kernels = create_kernels(std::make_index_sequence<letters>{});
+
+static_assert(caesar_rotator{13}('a') == 'n');
+static_assert(caesar_rotator{-1}('A') == 'Z');
+static_assert(caesar_rotator{1}('@') == '@');
+static_assert(caesar_rotator{1}('\xe9') == '\xe9');
+
+
+// Alternative implementations of the block rotation, for comparison
+// in benchmarks.  caesar_rotator itself uses the compiler's
+// vectorisation of a loop specialised for each rotation, which depends
+// on the target it's compiled for.
+namespace caesar_kernels
+{
+    using signature = void(const char *in, char *out, std::size_t n, int rotation) noexcept;
+
+    // A translation-table lookup for each character
+    inline void table(const char *in, char *out, std::size_t n, int rotation) noexcept
+    {
+        caesar_rotator const rotator{rotation};
+        for (std::size_t i = 0;  i < n;  ++i) {
+            out[i] = rotator(in[i]);
+        }
+    }
+
+    // Arithmetic, one character at a time
+    [[gnu::optimize("no-tree-vectorize")]]
+    inline void scalar(const char *in, char *out, std::size_t n, int rotation) noexcept
+    {
+        rotation = caesar_rotator::normalise(rotation);
+        for (std::size_t i = 0;  i < n;  ++i) {
+            out[i] = caesar_rotator::rotate(in[i], rotation);
+        }
+    }
+
+    // Arithmetic, Width characters at a time, using GCC vector extensions
+    template<std::size_t Width>
+    [[gnu::always_inline]]
+    inline void vector(const char *in, char *out, std::size_t n, int rotation) noexcept
+    {
+        typedef unsigned char bytes __attribute__((vector_size(Width)));
+        constexpr auto letters = static_cast<unsigned char>(caesar_rotator::letters);
+        auto const r = static_cast<unsigned char>(caesar_rotator::normalise(rotation));
+        auto const wrap_from = static_cast<unsigned char>(letters - r);
+
+        std::size_t i = 0;
+        for (;  i + Width <= n;  i += Width) {
+            bytes v;
+            std::memcpy(&v, in + i, Width);
+            bytes const offset = (v | 0x20) - 'a';
+            bytes const is_letter = offset < letters;
+            bytes const wraps = offset >= wrap_from;
+            v += (is_letter & r) - (is_letter & wraps & letters);
+            std::memcpy(out + i, &v, Width);
+        }
+        scalar(in + i, out + i, n - i, rotation);
+    }
+
+#if defined(__x86_64__) || defined(__i386__)
+    // Check __builtin_cpu_supports() before calling these.
+    [[gnu::target("sse2")]]
+    inline void sse2(const char *in, char *out, std::size_t n, int rotation) noexcept
+    {
+        vector<16>(in, out, n, rotation);
+    }
+
+    [[gnu::target("avx2")]]
+    inline void avx2(const char *in, char *out, std::size_t n, int rotation) noexcept
+    {
+        vector<32>(in, out, n, rotation);
+    }
+
+    [[gnu::target("avx512bw")]]
+    inline void avx512(const char *in, char *out, std::size_t n, int rotation) noexcept
+    {
+        vector<64>(in, out, n, rotation);
+    }
+#endif
+}
+
+
+// Rotate a column of strings stored Arrow-style, as an offsets array
+// and a byte buffer: string i is bytes [offsets[i], offsets[i+1]).
+// The output has the same layout, and may be the input buffer; bytes
+// outside [offsets.front(), offsets.back()) aren't touched.
+//
+// Rotation doesn't depend on string boundaries, so with a single
+// rotation the whole buffer is one call of the block kernel.
+template<std::integral Offset>
+void caesar_rotate_column(std::span<const Offset> offsets, const char *in, char *out,
+                          int rotation) noexcept
+{
+    if (offsets.size() < 2) {
+        return;
+    }
+    auto const first = static_cast<std::size_t>(offsets.front());
+    auto const last = static_cast<std::size_t>(offsets.back());
+    caesar_rotator{rotation}(in + first, out + first, last - first);
+}
+
+namespace caesar_column_detail
+{
+    // Rotate each byte by its own (normalised) rotation.  This
+    // vectorises like the block kernel, taking shifts from a vector.
+    inline void rotate_segmented(const char *in, char *out, const unsigned char *rotations,
+                                 std::size_t n) noexcept
+    {
+        constexpr auto letters = static_cast<unsigned char>(caesar_rotator::letters);
+        for (std::size_t i = 0;  i < n;  ++i) {
+            auto const u = static_cast<unsigned char>(in[i]);
+            auto const r = rotations[i];
+            auto const offset = static_cast<unsigned char>((u | 0x20) - 'a');
+            auto const shift = offset >= letters ? 0
+                : offset < letters - r ? r
+                : r - letters;
+            out[i] = static_cast<char>(u + shift);
+        }
+    }
+}
+
+// With a rotation per string, consecutive strings with equivalent
+// rotations are merged into runs.  Long runs are one call of the block
+// kernel each; short runs are gathered into segments, with a rotation
+// for each byte, so that columns of short strings with mixed rotations
+// are still rotated a vector at a time.
+template<std::integral Offset>
+void caesar_rotate_column(std::span<const Offset> offsets, const char *in, char *out,
+                          std::span<const int> rotations)
+{
+    if (offsets.size() < 2 ? !rotations.empty() : rotations.size() != offsets.size() - 1) {
+        throw std::invalid_argument("caesar_rotate_column: need one rotation per string");
+    }
+
+    // A run at least this long gets the block kernel to itself
+    constexpr std::size_t long_run = 64;
+    constexpr std::size_t segment_capacity = 4096;
+    std::array<unsigned char, segment_capacity + long_run> segment_rotations;
+    std::size_t segment_start = 0;
+    std::size_t segment_size = 0;
+    auto const flush_segment = [&]{
+        caesar_column_detail::rotate_segmented(in + segment_start, out + segment_start,
+                                               segment_rotations.data(), segment_size);
+        segment_size = 0;
+    };
+
+    // usually already normalised, so avoid the divisions
+    auto const normalise = [](int r) {
+        return static_cast<unsigned>(r) < caesar_rotator::letters ? r : caesar_rotator::normalise(r);
+    };
+
+    std::size_t i = 0;
+    while (i < rotations.size()) {
+        auto const rotation = normalise(rotations[i]);
+        auto j = i + 1;
+        while (j < rotations.size() && normalise(rotations[j]) == rotation) {
+            ++j;
+        }
+        auto const first = static_cast<std::size_t>(offsets[i]);
+        auto const last = static_cast<std::size_t>(offsets[j]);
+        i = j;
+
+        if (last - first >= long_run) {
+            if (segment_size) {
+                flush_segment();
+            }
+            if (rotation || in != out) {
+                caesar_rotator{rotation}(in + first, out + first, last - first);
+            }
+            continue;
+        }
+        if (segment_size + (last - first) > segment_capacity) {
+            flush_segment();
+        }
+        if (!segment_size) {
+            segment_start = first;
+        }
+        // a fixed-size fill (past the end of the run) is just a few vector stores
+        std::memset(segment_rotations.data() + segment_size, rotation, long_run);
+        segment_size += last - first;
+    }
+    if (segment_size) {
+        flush_segment();
+    }
+}
+
+
+// Rotates UTF-8 text.  Letters of the Latin-1 Supplement (U+00C0 -
+// U+00FF, such as é and ß) are first replaced by their base letters
+// (e and ss), and then rotated; all other non-ASCII characters are
+// copied unchanged, as are invalid sequences.
+//
+// Runs of ASCII are found a vector at a time by the high bits and
+// passed to the block kernel, so only actual multi-byte sequences are
+// decoded.  Each replacement is no longer than the character it
+// replaces, but a sequence split across calls is held back until the
+// next call (or finish()), so output needs room for one byte more
+// than the input.
+class caesar_utf8_rotator
+{
+    caesar_rotator rotator;
+    bool pending_lead = false;
+
+    // Lead byte of all the Latin-1 Supplement letters
+    static constexpr unsigned char latin1_lead = 0xC3;
+
+    // Base letters of U+00C0 - U+00FF, indexed by the continuation byte.
+    // Empty for the non-letters × and ÷.
+    static constexpr std::array<const char *, 64> base_letters = {
+        "A", "A", "A", "A", "A", "A", "AE", "C", "E", "E", "E", "E", "I", "I", "I", "I",
+        "D", "N", "O", "O", "O", "O", "O", "", "O", "U", "U", "U", "U", "Y", "TH", "ss",
+        "a", "a", "a", "a", "a", "a", "ae", "c", "e", "e", "e", "e", "i", "i", "i", "i",
+        "d", "n", "o", "o", "o", "o", "o", "", "o", "u", "u", "u", "u", "y", "th", "y",
+    };
+
+public:
+    caesar_utf8_rotator(int rotation) noexcept
+        : rotator{rotation}
+    {}
+
+    // Rotate n bytes from in to out (which must not overlap, and must
+    // have room for n+1 bytes).  Returns the number of bytes written.
+    std::size_t operator()(const char *in, char *out, std::size_t n) noexcept
+    {
+        std::size_t i = 0;
+        char *const out_start = out;
+
+        if (pending_lead && n) {
+            pending_lead = false;
+            if (!replace(static_cast<unsigned char>(in[0]), out)) {
+                *out++ = static_cast<char>(latin1_lead);
+            } else {
+                ++i;
+            }
+        }
+
+        while (i < n) {
+            auto const run = ascii_prefix(in + i, n - i);
+            rotator(in + i, out, run);
+            i += run;
+            out += run;
+            if (i == n) {
+                break;
+            }
+
+            // Multi-byte sequence (or invalid byte)
+            if (static_cast<unsigned char>(in[i]) == latin1_lead) {
+                if (i + 1 == n) {
+                    pending_lead = true;
+                    ++i;
+                    break;
+                }
+                if (replace(static_cast<unsigned char>(in[i + 1]), out)) {
+                    i += 2;
+                    continue;
+                }
+            }
+            *out++ = in[i++];
+        }
+        return static_cast<std::size_t>(out - out_start);
+    }
+
+    // Write any byte held back at the end of the input (at most one).
+    std::size_t finish(char *out) noexcept
+    {
+        if (!pending_lead) {
+            return 0;
+        }
+        pending_lead = false;
+        *out = static_cast<char>(latin1_lead);
+        return 1;
+    }
+
+private:
+    // Write the rotated base letters for U+00C0 + (continuation & 0x3F)
+    bool replace(unsigned char continuation, char *&out) const noexcept
+    {
+        if ((continuation & 0xC0) != 0x80) {
+            return false;
+        }
+        auto const *base = base_letters[continuation & 0x3F];
+        if (!*base) {
+            return false;
+        }
+        for (;  *base;  ++base) {
+            *out++ = rotator(*base);
+        }
+        return true;
+    }
+
+    // Length of the initial run of ASCII (high bit clear) in p[0..n)
+    static std::size_t ascii_prefix(const char *p, std::size_t n) noexcept
+    {
+        std::size_t i = 0;
+#ifdef __SSE2__
+        for (;  i + sizeof (__m128i) <= n;  i += sizeof (__m128i)) {
+            auto const v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + i));
+            if (auto const mask = static_cast<unsigned>(_mm_movemask_epi8(v))) {
+                return i + static_cast<std::size_t>(std::countr_zero(mask));
+            }
+        }
+#endif
+        while (i < n && !(static_cast<unsigned char>(p[i]) & 0x80)) {
+            ++i;
+        }
+        return i;
+    }
+};
+
+// A stream buffer that rotates everything read from or written to
+// another stream buffer.
+//
+// Data passes through in whole blocks: the get area is filled and
+// rotated a buffer at a time, and the put area is rotated when
+// flushed.  Large reads go straight into the caller's buffer and large
+// writes are rotated directly into the put buffer, so bulk transfers
+// avoid both per-character virtual calls and an extra copy.
+//
+// The underlying buffer must outlive this object.  Seeking is not
+// supported.
+class caesar_streambuf : public std::streambuf
+{
+    std::streambuf *inner;
+    caesar_rotator rotator;
+    std::size_t buffer_size;
+    // allocated on first use, so one-directional use costs only one
+    std::unique_ptr<char[]> get_buffer = {};
+    std::unique_ptr<char[]> put_buffer = {};
+
+public:
+    static constexpr std::size_t default_buffer_size = 1 << 16;
+
+    caesar_streambuf(std::streambuf *inner, int rotation,
+                     std::size_t buffer_size = default_buffer_size)
+        : inner{inner},
+          rotator{rotation},
+          buffer_size{buffer_size ? buffer_size : 1}
+    {}
+
+    caesar_streambuf(const caesar_streambuf&) = delete;
+    void operator=(const caesar_streambuf&) = delete;
+
+    ~caesar_streambuf() override
+    {
+        flush_put_area();
+    }
+
+protected:
+    // Reading
+
+    int_type underflow() override
+    {
+        if (gptr() == egptr()) {
+            if (!get_buffer) {
+                get_buffer = std::make_unique<char[]>(buffer_size);
+            }
+            // take only what's available without blocking
+            if (traits_type::eq_int_type(inner->sgetc(), traits_type::eof())) {
+                return traits_type::eof();
+            }
+            auto const available = std::max(inner->in_avail(), std::streamsize{1});
+            auto const n = inner->sgetn(get_buffer.get(),
+                                        std::min(available, as_streamsize(buffer_size)));
+            if (n <= 0) {
+                return traits_type::eof();
+            }
+            rotator(get_buffer.get(), get_buffer.get(), static_cast<std::size_t>(n));
+            setg(get_buffer.get(), get_buffer.get(), get_buffer.get() + n);
+        }
+        return traits_type::to_int_type(*gptr());
+    }
+
+    std::streamsize xsgetn(char *s, std::streamsize count) override
+    {
+        // First, whatever is already rotated in the get area
+        std::streamsize done = 0;
+        while (done < count && gptr() != egptr()) {
+            done += take_buffered(s + done, count - done);
+        }
+
+        // Big reads go directly to the caller's storage
+        while (count - done >= as_streamsize(buffer_size)) {
+            auto const n = inner->sgetn(s + done, count - done);
+            if (n <= 0) {
+                return done;
+            }
+            rotator(s + done, s + done, static_cast<std::size_t>(n));
+            done += n;
+        }
+
+        // Small remainder comes via the get area
+        while (done < count && underflow() != traits_type::eof()) {
+            done += take_buffered(s + done, count - done);
+        }
+        return done;
+    }
+
+    std::streamsize showmanyc() override
+    {
+        return inner->in_avail();
+    }
+
+    // Writing
+
+    int_type overflow(int_type c) override
+    {
+        if (!put_buffer) {
+            put_buffer = std::make_unique<char[]>(buffer_size);
+            setp(put_buffer.get(), put_buffer.get() + buffer_size);
+        } else if (!flush_put_area()) {
+            return traits_type::eof();
+        }
+        if (traits_type::eq_int_type(c, traits_type::eof())) {
+            return traits_type::not_eof(c);
+        }
+        return sputc(traits_type::to_char_type(c));
+    }
+
+    std::streamsize xsputn(const char *s, std::streamsize count) override
+    {
+        if (count <= 0) {
+            // nothing to copy, and there may be no put area yet
+            return 0;
+        }
+        if (count <= epptr() - pptr() && count <= max_bump) {
+            // fits in the put area
+            std::memcpy(pptr(), s, static_cast<std::size_t>(count));
+            pbump(static_cast<int>(count));
+            return count;
+        }
+
+        // Rotate whole buffers straight out of the caller's storage
+        if (overflow(traits_type::eof()) == traits_type::eof()) {
+            return 0;
+        }
+        std::streamsize done = 0;
+        while (count - done >= as_streamsize(buffer_size)) {
+            rotator(s + done, put_buffer.get(), buffer_size);
+            auto const n = inner->sputn(put_buffer.get(), as_streamsize(buffer_size));
+            done += n;
+            if (n < as_streamsize(buffer_size)) {
+                return done;
+            }
+        }
+
+        // and keep the tail for later
+        while (done < count) {
+            auto const n = std::min(count - done, max_bump);
+            std::memcpy(pptr(), s + done, static_cast<std::size_t>(n));
+            pbump(static_cast<int>(n));
+            done += n;
+        }
+        return count;
+    }
+
+    int sync() override
+    {
+        return flush_put_area() ? inner->pubsync() : -1;
+    }
+
+private:
+    // gbump() and pbump() take int, so larger moves go in steps
+    static constexpr std::streamsize max_bump = INT_MAX;
+
+    // Copy out of a non-empty get area, returning the number of chars taken
+    std::streamsize take_buffered(char *s, std::streamsize count)
+    {
+        auto const n = std::min({count, egptr() - gptr(), max_bump});
+        std::memcpy(s, gptr(), static_cast<std::size_t>(n));
+        gbump(static_cast<int>(n));
+        return n;
+    }
+
+    bool flush_put_area()
+    {
+        auto const n = pptr() - pbase();
+        if (!n) {
+            return true;
+        }
+        rotator(pbase(), pbase(), static_cast<std::size_t>(n));
+        auto const written = inner->sputn(pbase(), n);
+        setp(pbase(), epptr());
+        return written == n;
+    }
+
+    static std::streamsize as_streamsize(std::size_t n)
+    {
+        return static_cast<std::streamsize>(n);
+    }
+};
+
+
+template<typename I>
+concept contiguous_chars =
+    std::contiguous_iterator<I> && std::same_as<std::iter_value_t<I>, char>;
+
+// A view that rotates the characters of an underlying view.
+//
+// Iteration is element by element, so it composes with any other
+// adaptors.  For bulk consumers, copy() recognises at compile time when
+// both the underlying range and the output are contiguous, and then
+// uses the block kernel instead.
+template<std::ranges::input_range V>
+    requires std::ranges::view<V>
+          && std::convertible_to<std::ranges::range_reference_t<V>, char>
+class caesar_view : public std::ranges::view_interface<caesar_view<V>>
+{
+    caesar_rotator rotator;
+    std::ranges::transform_view<V, caesar_rotator> view;
+
+public:
+    caesar_view(V base, int rotation)
+        : rotator{rotation},
+          view{std::move(base), rotator}
+    {}
+
+    V base() const& requires std::copy_constructible<V> { return view.base(); }
+    V base() && { return std::move(view).base(); }
+
+    auto begin() { return view.begin(); }
+    auto begin() const requires std::ranges::range<const V> { return view.begin(); }
+
+    auto end() { return view.end(); }
+    auto end() const requires std::ranges::range<const V> { return view.end(); }
+
+    auto size() requires std::ranges::sized_range<V> { return view.size(); }
+    auto size() const requires std::ranges::sized_range<const V> { return view.size(); }
+
+    // Write the rotated characters to out, returning the end of the output.
+    template<std::weakly_incrementable O>
+        requires std::indirectly_writable<O, char>
+    O copy(O out) const
+        requires std::ranges::input_range<const V>
+    {
+        if constexpr (contiguous_chars<std::ranges::iterator_t<const V>>
+                      && std::ranges::sized_range<const V>
+                      && contiguous_chars<O>) {
+            auto const n = static_cast<std::size_t>(std::ranges::size(view));
+            rotator(std::to_address(view.begin().base()), std::to_address(out), n);
+            return out + static_cast<std::iter_difference_t<O>>(n);
+        } else {
+            return std::ranges::copy(view, std::move(out)).out;
+        }
+    }
+};
+
+template<typename R>
+caesar_view(R&&, int) -> caesar_view<std::views::all_t<R>>;
+
+namespace views
+{
+    // text | views::caesar(rotation)   or   views::caesar(text, rotation)
+    struct caesar_fn
+    {
+        template<std::ranges::viewable_range R>
+        auto operator()(R&& range, int rotation) const
+        {
+            return caesar_view{std::forward<R>(range), rotation};
+        }
+
+        struct closure
+        {
+            int rotation;
+
+            template<std::ranges::viewable_range R>
+            friend auto operator|(R&& range, closure c)
+            {
+                return caesar_view{std::forward<R>(range), c.rotation};
+            }
+        };
+
+        constexpr closure operator()(int rotation) const noexcept
+        {
+            return {rotation};
+        }
+    };
+
+    inline constexpr caesar_fn caesar = {};
+}
+
+#endif // CAESAR_H
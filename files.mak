@@ -0,0 +1,18 @@
+OPTIMIZED += caesar-cipher caesar-bench restore-stream-bench bench
+
+caesar-cipher: caesar.hh thread-pool/pool.hh trace/trace.hh
+caesar-cipher: LDLIBS += -pthread
+caesar-bench: caesar.hh
+caesar-bench: LDLIBS += -pthread
+caesar: caesar.hh thread-pool/pool.hh alloc-count/alloc-count.hh
+
+restore-stream: restore-stream.hh format-sink.hh alloc-count/alloc-count.hh
+restore-stream-demo: restore-stream.hh format-sink.hh
+restore-stream-bench: restore-stream.hh format-sink.hh
+restore-stream-bench: LDLIBS += -pthread
+
+USING_GTEST += caesar restore-stream
+
+bench: caesar.hh median/median.hh triple-buffer/buffer.hh thread-pool/pool.hh trace/trace.hh
+bench: CPPFLAGS += -DBENCH_CXXFLAGS='"$(CXXFLAGS)"'
+bench: LDLIBS += -pthread
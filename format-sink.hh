@@ -0,0 +1,285 @@
+#ifndef FORMAT_SINK_H
+#define FORMAT_SINK_H
+
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <cmath>
+#include <concepts>
+#include <ostream>
+#include <span>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <type_traits>
+#include <vector>
+
+/*
+  Formatting that doesn't depend on (or change) any stream state.
+
+  Iostream formatting state is sticky, which is why we need save_stream_state to undo changes.
+  Instead, a format_sink takes the whole specification with each value, formats it into its own
+  reusable buffer with std::to_chars(), and passes the characters straight to the stream buffer.
+  There's no sentry, no locale facets and no flags to restore, and the output is identical to
+  what the stream would produce with the same settings in the "C" locale.
+
+      format_sink out{std::cout};
+      out(255, {.width = 6, .fill = '0', .adjust = format_spec::internal,
+                .base = 16, .showbase = true})      // 0x00ff
+         (' ')
+         (3.14159, {.precision = 3})                 // 3.14
+         (true, {.boolalpha = true});                // true
+
+  Tied streams are not flushed.  Errors writing to the stream buffer set badbit on the stream.
+ */
+
+struct format_spec
+{
+    enum adjustment : char { right, left, internal };
+    enum float_format : char { general, fixed, scientific, hexfloat };
+
+    int width = 0;
+    char fill = ' ';
+    adjustment adjust = right;
+    int base = 10;              // 8, 10 or 16
+    bool showbase = false;
+    bool showpos = false;
+    bool uppercase = false;
+    int precision = 6;
+    float_format floatfield = general;
+    bool boolalpha = false;
+};
+
+template<class CharT, class Traits = typename std::char_traits<CharT>>
+class format_sink
+{
+    std::basic_ostream<CharT,Traits>& stream;
+    // Reused by each call.  Only very long floating-point values need
+    // more than the inline buffer, so constructing a sink is cheap.
+    std::array<char, 128> small = {};
+    std::vector<char> large = {};
+    std::span<char> chars = small;
+
+    template<typename T>
+    static constexpr bool is_character =
+        std::same_as<T, char> || std::same_as<T, signed char> || std::same_as<T, unsigned char>
+        || std::same_as<T, CharT>;
+
+public:
+    explicit format_sink(std::basic_ostream<CharT,Traits>& stream)
+        : stream{stream}
+    {}
+
+    format_sink(const format_sink&) = delete;
+    void operator=(const format_sink&) = delete;
+
+    // Integers (including bool, when !boolalpha)
+    template<std::integral T>
+        requires (!is_character<T>)
+    format_sink& operator()(T value, const format_spec& spec = {})
+    {
+        if constexpr (std::same_as<T, bool>) {
+            if (spec.boolalpha) {
+                return (*this)(std::string_view{value ? "true" : "false"}, spec);
+            }
+            return (*this)(static_cast<long>(value), spec);
+        } else {
+            std::string_view prefix = "";
+            if (spec.base == 10) {
+                if (value < 0) {
+                    prefix = "-";
+                } else if (spec.showpos && std::signed_integral<T>) {
+                    prefix = "+";
+                }
+            } else if (spec.showbase && value != 0) {
+                prefix = spec.base == 8 ? "0" : spec.uppercase ? "0X" : "0x";
+            }
+
+            // Like iostreams, show the magnitude in base 10, but the
+            // two's complement representation in other bases.
+            using U = std::make_unsigned_t<T>;
+            U const magnitude = spec.base == 10 && value < 0
+                ? static_cast<U>(U{0} - static_cast<U>(value))
+                : static_cast<U>(value);
+            auto *const digits = std::copy(prefix.begin(), prefix.end(), chars.data());
+            auto const result = std::to_chars(digits, chars.data() + chars.size(), magnitude, spec.base);
+            if (spec.uppercase) {
+                std::transform(digits, result.ptr, digits, to_upper);
+            }
+            write_number(std::string_view{chars.data(), result.ptr}, spec);
+            return *this;
+        }
+    }
+
+    // Floating point
+    template<std::floating_point T>
+    format_sink& operator()(T value, const format_spec& spec = {})
+    {
+        auto const negative = std::signbit(value);
+        std::string_view prefix = negative ? "-" : spec.showpos ? "+" : "";
+        auto const hex = spec.floatfield == format_spec::hexfloat && std::isfinite(value);
+        // Fixed format ignores uppercase (it's %f, not %F)
+        auto const upper = spec.uppercase && spec.floatfield != format_spec::fixed;
+
+        std::to_chars_result result;
+        char *digits;
+        for (;;) {
+            digits = std::copy(prefix.begin(), prefix.end(), chars.data());
+            if (hex) {
+                *digits++ = '0';
+                *digits++ = upper ? 'X' : 'x';
+            }
+            result = convert(digits, negative ? -value : value, spec);
+            if (result.ec != std::errc::value_too_large) {
+                break;
+            }
+            large.resize(chars.size() * 2);
+            chars = large;
+        }
+        if (upper) {
+            std::transform(digits, result.ptr, digits, to_upper);
+        }
+        write_number(std::string_view{chars.data(), result.ptr}, spec);
+        return *this;
+    }
+
+    // Characters
+    template<typename T>
+        requires is_character<T>
+    format_sink& operator()(T c, const format_spec& spec = {})
+    {
+        if constexpr (std::same_as<T, CharT>) {
+            write({}, std::basic_string_view<CharT,Traits>{&c, 1}, spec);
+        } else {
+            auto const narrow = static_cast<char>(c);
+            write({}, std::string_view{&narrow, 1}, spec);
+        }
+        return *this;
+    }
+
+    // Strings
+    format_sink& operator()(std::basic_string_view<CharT,Traits> s, const format_spec& spec = {})
+    {
+        write({}, s, spec);
+        return *this;
+    }
+
+    format_sink& operator()(const CharT *s, const format_spec& spec = {})
+    {
+        return (*this)(std::basic_string_view<CharT,Traits>{s}, spec);
+    }
+
+    template<class Allocator>
+    format_sink& operator()(const std::basic_string<CharT,Traits,Allocator>& s,
+                            const format_spec& spec = {})
+    {
+        return (*this)(std::basic_string_view<CharT,Traits>{s}, spec);
+    }
+
+    // Narrow strings into a wide stream
+    format_sink& operator()(std::string_view s, const format_spec& spec = {})
+        requires (!std::same_as<CharT, char>)
+    {
+        write({}, s, spec);
+        return *this;
+    }
+
+private:
+    template<std::floating_point T>
+    std::to_chars_result convert(char *first, T value, const format_spec& spec)
+    {
+        auto *const last = chars.data() + chars.size();
+        switch (spec.floatfield) {
+        case format_spec::fixed:
+            return std::to_chars(first, last, value, std::chars_format::fixed, spec.precision);
+        case format_spec::scientific:
+            return std::to_chars(first, last, value, std::chars_format::scientific, spec.precision);
+        case format_spec::hexfloat:
+            return std::to_chars(first, last, value, std::chars_format::hex);
+        case format_spec::general:
+            break;
+        }
+        return std::to_chars(first, last, value, std::chars_format::general, spec.precision);
+    }
+
+    static char to_upper(char c)
+    {
+        return c >= 'a' && c <= 'z' ? static_cast<char>(c - 'a' + 'A') : c;
+    }
+
+    // Write a formatted number.  Internal padding goes after any sign,
+    // or else after a hexadecimal prefix.
+    void write_number(std::string_view s, const format_spec& spec)
+    {
+        std::size_t split = 0;
+        if (s.starts_with('-') || s.starts_with('+')) {
+            split = 1;
+        } else if (s.starts_with("0x") || s.starts_with("0X")) {
+            split = 2;
+        }
+        write(s.substr(0, split), s.substr(split), spec);
+    }
+
+    // Write prefix and body, padded to the spec's width.
+    // Body may be narrow or of the stream's character type.
+    template<typename BodyChar, typename BodyTraits>
+    void write(std::string_view prefix, std::basic_string_view<BodyChar,BodyTraits> body,
+               const format_spec& spec)
+    {
+        auto const length = static_cast<std::streamsize>(prefix.size() + body.size());
+        auto const padding = std::max(std::streamsize{spec.width} - length, std::streamsize{0});
+        switch (spec.adjust) {
+        case format_spec::left:
+            put(prefix);
+            put(body);
+            pad(padding, spec.fill);
+            break;
+        case format_spec::internal:
+            put(prefix);
+            pad(padding, spec.fill);
+            put(body);
+            break;
+        case format_spec::right:
+            pad(padding, spec.fill);
+            put(prefix);
+            put(body);
+            break;
+        }
+    }
+
+    void put(std::basic_string_view<CharT,Traits> s)
+    {
+        auto const n = static_cast<std::streamsize>(s.size());
+        if (n && stream.rdbuf()->sputn(s.data(), n) != n) {
+            stream.setstate(std::ios_base::badbit);
+        }
+    }
+
+    // Narrow characters are all from the basic character set, so can
+    // be widened without reference to the locale.
+    void put(std::string_view s)
+        requires (!std::same_as<CharT, char>)
+    {
+        std::array<CharT, 64> wide;
+        while (!s.empty()) {
+            auto const n = std::min(s.size(), wide.size());
+            std::transform(s.begin(), s.begin() + n, wide.begin(),
+                           [](char c){ return static_cast<CharT>(c); });
+            put(std::basic_string_view<CharT,Traits>{wide.data(), n});
+            s.remove_prefix(n);
+        }
+    }
+
+    void pad(std::streamsize n, char fill)
+    {
+        std::array<CharT, 64> fills;
+        fills.fill(static_cast<CharT>(fill));
+        while (n > 0) {
+            auto const chunk = std::min(n, static_cast<std::streamsize>(fills.size()));
+            put(std::basic_string_view<CharT,Traits>{fills.data(), static_cast<std::size_t>(chunk)});
+            n -= chunk;
+        }
+    }
+};
+
+#endif // FORMAT_SINK_H
@@ -1,3 +1,15 @@
-median: median.hh
+median: median.hh ../trace/trace.hh ../thread-pool/pool.hh ../alloc-count/alloc-count.hh
 
 USING_GTEST += median
+
+pairwise: median.hh ../trace/trace.hh pairwise.hh
+USING_GTEST += pairwise
+
+OPTIMIZED += pairwise-bench
+pairwise-bench: median.hh ../trace/trace.hh pairwise.hh
+
+geometric: median.hh ../trace/trace.hh ../thread-pool/pool.hh geometric.hh
+USING_GTEST += geometric
+
+memo: median.hh ../trace/trace.hh memo.hh
+USING_GTEST += memo
@@ -0,0 +1,149 @@
+#include "geometric.hh"
+
+#include <gtest/gtest.h>
+#include <array>
+#include <cmath>
+#include <random>
+#include <stdexcept>
+#include <vector>
+
+using coordinates = std::vector<std::vector<double>>;
+
+// Sum of distances from p to all the points
+static double cost(coordinates const& c, std::vector<double> const& p)
+{
+    double total = 0;
+    for (std::size_t i = 0;  i < c[0].size();  ++i) {
+        double d2 = 0;
+        for (std::size_t k = 0;  k < c.size();  ++k) {
+            d2 += (c[k][i] - p[k]) * (c[k][i] - p[k]);
+        }
+        total += std::sqrt(d2);
+    }
+    return total;
+}
+
+// p is no worse than any nearby point
+static void expect_minimal(coordinates const& c, std::vector<double> const& p, double delta = 1e-4)
+{
+    auto const at_p = cost(c, p);
+    for (std::size_t k = 0;  k < c.size();  ++k) {
+        for (double step: {-delta, delta}) {
+            auto q = p;
+            q[k] += step;
+            EXPECT_LE(at_p, cost(c, q) + 1e-9) << "coordinate " << k << ", step " << step;
+        }
+    }
+}
+
+static coordinates random_cloud(std::size_t dims, std::size_t n, unsigned seed)
+{
+    std::mt19937 gen{seed};
+    std::normal_distribution<double> normal{0, 1};
+    std::cauchy_distribution<double> outlier{0, 50};
+    coordinates c(dims, std::vector<double>(n));
+    for (std::size_t i = 0;  i < n;  ++i) {
+        for (std::size_t k = 0;  k < dims;  ++k) {
+            c[k][i] = 10.0 * static_cast<double>(k) + (i % 20 ? normal(gen) : outlier(gen));
+        }
+    }
+    return c;
+}
+
+
+TEST(GeometricMedian, Errors)
+{
+    EXPECT_THROW(stats::geometric_median(coordinates{}), std::invalid_argument);
+    EXPECT_THROW(stats::geometric_median(coordinates{{}, {}}), std::invalid_argument);
+    EXPECT_THROW(stats::geometric_median(coordinates{{1.0, 2.0}, {1.0}}), std::invalid_argument);
+}
+
+TEST(GeometricMedian, SinglePoint)
+{
+    auto const result = stats::geometric_median(coordinates{{3.0}, {4.0}});
+    EXPECT_EQ(result.point, (std::vector{3.0, 4.0}));
+    EXPECT_TRUE(result.converged);
+}
+
+TEST(GeometricMedian, OneDimension)
+{
+    // the ordinary median
+    auto const result = stats::geometric_median(coordinates{{5.0, 1.0, 100.0, 2.0, 3.0}});
+    EXPECT_TRUE(result.converged);
+    EXPECT_NEAR(result.point[0], 3.0, 1e-9);
+}
+
+TEST(GeometricMedian, Square)
+{
+    auto const result = stats::geometric_median(coordinates{{0, 2, 2, 0}, {0, 0, 2, 2}});
+    EXPECT_TRUE(result.converged);
+    EXPECT_NEAR(result.point[0], 1.0, 1e-9);
+    EXPECT_NEAR(result.point[1], 1.0, 1e-9);
+}
+
+TEST(GeometricMedian, AtDataPoint)
+{
+    // The optimum is the data point at the origin, which plain Weiszfeld can't step onto
+    auto const c = coordinates{{0, 1, -1, 0, 0}, {0, 0, 0, 1, -1}, {0, 0.2, 0.2, 0.2, 0.2}};
+    for (bool warm: {true, false}) {
+        auto const result = stats::geometric_median(c, {.warm_start = warm});
+        EXPECT_TRUE(result.converged);
+        for (auto const v: result.point) {
+            EXPECT_NEAR(v, 0.0, 1e-6);
+        }
+    }
+}
+
+TEST(GeometricMedian, NaN)
+{
+    auto const nan = std::numeric_limits<double>::quiet_NaN();
+    auto const result = stats::geometric_median(coordinates{{0, 1, nan}, {0, 0, 0}});
+    EXPECT_FALSE(result.converged);
+}
+
+TEST(GeometricMedian, Cloud)
+{
+    for (std::size_t dims: {2, 3, 7}) {
+        auto const c = random_cloud(dims, 1000, static_cast<unsigned>(dims));
+        auto const result = stats::geometric_median(c);
+        EXPECT_TRUE(result.converged);
+        expect_minimal(c, result.point);
+    }
+}
+
+TEST(GeometricMedian, WarmStartHelps)
+{
+    auto const c = random_cloud(3, 5000, 1);
+    auto const warm = stats::geometric_median(c);
+    auto const cold = stats::geometric_median(c, {.warm_start = false});
+    EXPECT_LT(warm.iterations, cold.iterations);
+    for (std::size_t k = 0;  k < c.size();  ++k) {
+        EXPECT_NEAR(warm.point[k], cold.point[k], 1e-6);
+    }
+}
+
+TEST(GeometricMedian, Threads)
+{
+    auto const c = random_cloud(3, 10007, 2);
+    auto const single = stats::geometric_median(c, {.threads = 1});
+    auto const multi = stats::geometric_median(c, {.threads = 4, .min_points_per_thread = 1000});
+    EXPECT_TRUE(multi.converged);
+    for (std::size_t k = 0;  k < c.size();  ++k) {
+        EXPECT_NEAR(single.point[k], multi.point[k], 1e-8);
+    }
+}
+
+TEST(GeometricMedian, Executor)
+{
+    auto const c = random_cloud(3, 10007, 2);
+    thread_pool pool{2};
+    auto const single = stats::geometric_median(c, {.threads = 1});
+    auto const pooled = stats::geometric_median(c, pool, {.min_points_per_thread = 1000});
+    EXPECT_TRUE(pooled.converged);
+    for (std::size_t k = 0;  k < c.size();  ++k) {
+        EXPECT_NEAR(single.point[k], pooled.point[k], 1e-8);
+    }
+    // the pool is reusable
+    auto const again = stats::geometric_median(c, pool, {.min_points_per_thread = 1000});
+    EXPECT_EQ(again.point, pooled.point);
+}
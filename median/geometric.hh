@@ -0,0 +1,299 @@
+#ifndef GEOMETRIC_H
+#define GEOMETRIC_H
+
+#include "median.hh"
+#include "../thread-pool/pool.hh"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <functional>
+#include <numeric>
+#include <ranges>
+#include <span>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+/*
+  Geometric median (the point minimising the sum of Euclidean distances) of points in any number
+  of dimensions, given as structure-of-arrays: coordinates[k][i] is the k-th coordinate of the
+  i-th point.
+
+      std::vector<double> xs = ..., ys = ..., zs = ...;
+      auto const result = stats::geometric_median(std::array{xs, ys, zs});
+      // result.point is { x, y, z }
+
+  This uses Weiszfeld's iteration, with Vardi and Zhang's modification so that it still converges
+  when an iterate lands on a data point.  It starts from the coordinate-wise median, which is
+  usually much closer than the centroid.  The distance kernels work on blocks of points, one
+  coordinate at a time, so that they vectorise; large inputs are divided between threads.
+
+      stats::geometric_median(coordinates, pool)    // on an executor such as thread_pool
+      stats::geometric_median(coordinates)          // on a thread_pool made for the call, if large
+ */
+
+namespace stats
+{
+    struct geometric_median_options
+    {
+        double tolerance = 1e-10;       // relative change in the estimate
+        unsigned max_iterations = 1000;
+        unsigned threads = 0;           // at most; 0 for one per hardware thread (or executor thread)
+        std::size_t min_points_per_thread = 1 << 16;
+        bool warm_start = true;         // start from coordinate-wise median, rather than centroid
+    };
+
+    struct geometric_median_result
+    {
+        std::vector<double> point;
+        unsigned iterations;
+        bool converged;
+    };
+
+    namespace geometric_detail
+    {
+        // Sums over a subset of the points, relative to the current estimate y
+        struct partial_sums
+        {
+            std::vector<double> weighted;   // Σ xᵢ/dᵢ, per coordinate
+            double weight = 0;              // Σ 1/dᵢ
+            double distance = 0;            // Σ dᵢ
+            std::size_t coincident = 0;     // count of points at y
+
+            explicit partial_sums(std::size_t dimensions)
+                : weighted(dimensions)
+            {}
+
+            void reset()
+            {
+                std::ranges::fill(weighted, 0.0);
+                weight = distance = 0;
+                coincident = 0;
+            }
+
+            partial_sums& operator+=(partial_sums const& other)
+            {
+                std::ranges::transform(weighted, other.weighted, weighted.begin(), std::plus<>{});
+                weight += other.weight;
+                distance += other.distance;
+                coincident += other.coincident;
+                return *this;
+            }
+        };
+
+        // Accumulate sums for points [first, last).  Each block is processed one coordinate at
+        // a time, with independent accumulators per lane, so that every inner loop is a
+        // contiguous, vectorisable pass.  (Floating-point sums can't be reordered by the
+        // compiler, so the lanes must be explicit.)
+        [[gnu::optimize("no-math-errno")]]
+        inline void accumulate(std::span<const double* const> coordinates, std::span<const double> y,
+                               std::size_t first, std::size_t last, partial_sums& sums)
+        {
+            constexpr std::size_t block = 256;
+            constexpr std::size_t lanes = 8;
+            alignas(64) double d2[block];
+            alignas(64) double w[block];
+            auto const dims = coordinates.size();
+
+            for (auto begin = first;  begin < last;  begin += block) {
+                auto const count = std::min(block, last - begin);
+
+                std::fill_n(d2, count, 0.0);
+                for (std::size_t k = 0;  k < dims;  ++k) {
+                    auto const *const x = coordinates[k] + begin;
+                    auto const yk = y[k];
+                    for (std::size_t j = 0;  j < count;  ++j) {
+                        auto const diff = x[j] - yk;
+                        d2[j] += diff * diff;
+                    }
+                }
+
+                std::array<double, lanes> weight{}, distance{};
+                std::size_t coincident = 0;
+                for (std::size_t j = 0;  j < count;  ++j) {
+                    auto const d = std::sqrt(d2[j]);
+                    w[j] = d > 0 ? 1 / d : 0;
+                    coincident += d > 0 ? 0 : 1;
+                    weight[j % lanes] += w[j];
+                    distance[j % lanes] += d;
+                }
+                for (std::size_t l = 0;  l < lanes;  ++l) {
+                    sums.weight += weight[l];
+                    sums.distance += distance[l];
+                }
+                sums.coincident += coincident;
+
+                for (std::size_t k = 0;  k < dims;  ++k) {
+                    auto const *const x = coordinates[k] + begin;
+                    std::array<double, lanes> weighted{};
+                    for (std::size_t j = 0;  j < count;  ++j) {
+                        weighted[j % lanes] += x[j] * w[j];
+                    }
+                    for (std::size_t l = 0;  l < lanes;  ++l) {
+                        sums.weighted[k] += weighted[l];
+                    }
+                }
+            }
+        }
+    }
+
+    namespace geometric_detail
+    {
+        // The columns of coordinates, and their common length
+        template<std::ranges::input_range Coordinates>
+        std::pair<std::vector<const double*>, std::size_t> columns_of(Coordinates&& coordinates)
+        {
+            std::vector<const double*> columns;
+            std::size_t n = 0;
+            for (auto&& c: coordinates) {
+                auto const size = static_cast<std::size_t>(std::ranges::size(c));
+                if (columns.empty()) {
+                    n = size;
+                } else if (size != n) {
+                    throw std::invalid_argument("Coordinate arrays differ in length");
+                }
+                columns.push_back(std::ranges::data(c));
+            }
+            if (columns.empty() || n == 0) {
+                throw std::invalid_argument("Attempting geometric median of no points");
+            }
+            return {std::move(columns), n};
+        }
+
+        // Threads worth using for n points, up to the given limit
+        inline std::size_t useful_threads(std::size_t n, std::size_t limit, const geometric_median_options& options)
+        {
+            if (options.threads) {
+                limit = std::min<std::size_t>(limit, options.threads);
+            }
+            return std::clamp<std::size_t>(n / std::max<std::size_t>(options.min_points_per_thread, 1),
+                                           1, std::max<std::size_t>(limit, 1));
+        }
+
+        // Runs everything on the calling thread
+        struct serial_executor
+        {
+            std::size_t concurrency() const { return 1; }
+
+            template<typename Body>
+            void parallel_for(std::size_t n, Body&& body, std::size_t)
+            {
+                if (n) {
+                    body(std::size_t{0}, n);
+                }
+            }
+        };
+
+        template<executor Executor>
+        geometric_median_result solve(std::span<const double* const> columns, std::size_t n,
+                                      Executor& executor, const geometric_median_options& options)
+        {
+            auto const dims = columns.size();
+
+            // Initial estimate
+            std::vector<double> y(dims);
+            for (std::size_t k = 0;  k < dims;  ++k) {
+                auto const column = std::span{columns[k], n};
+                y[k] = options.warm_start
+                    ? median.using_arithmetic_midpoint()(column)
+                    : std::accumulate(column.begin(), column.end(), 0.0) / static_cast<double>(n);
+            }
+
+            // Divide the points into a chunk per thread, each with its own partial sums
+            auto const chunks = useful_threads(n, executor.concurrency(), options);
+            std::vector<partial_sums> partials(chunks, partial_sums{dims});
+            auto const chunk = (n + chunks - 1) / chunks;
+            auto const work = [&](std::size_t first, std::size_t last) {
+                for (auto t = first;  t < last;  ++t) {
+                    partials[t].reset();
+                    geometric_detail::accumulate(columns, y, std::min(n, t * chunk), std::min(n, (t + 1) * chunk), partials[t]);
+                }
+            };
+
+            geometric_median_result result{{}, 0, false};
+            partial_sums sums{dims};
+            std::vector<double> next(dims);
+            while (result.iterations < options.max_iterations) {
+                ++result.iterations;
+                executor.parallel_for(chunks, work, 1);
+                sums.reset();
+                for (auto const& p: partials) {
+                    sums += p;
+                }
+
+                if (!std::isfinite(sums.distance)) {
+                    // NaN or infinite coordinates
+                    break;
+                }
+                if (sums.weight == 0) {
+                    // every point is at y
+                    result.converged = true;
+                    break;
+                }
+
+                // Weiszfeld step: T(y) = Σ(xᵢ/dᵢ) / Σ(1/dᵢ), over points not at y.
+                // If some points coincide with y, Vardi-Zhang mixes in y itself:
+                // y' = (1 - η/r)⁺ T(y) + min(1, η/r) y, where r = |Σ (xᵢ - y)/dᵢ|.
+                double r2 = 0;
+                for (std::size_t k = 0;  k < dims;  ++k) {
+                    next[k] = sums.weighted[k] / sums.weight;
+                    auto const rk = sums.weighted[k] - y[k] * sums.weight;
+                    r2 += rk * rk;
+                }
+                if (sums.coincident) {
+                    auto const ratio = static_cast<double>(sums.coincident) / std::sqrt(r2);
+                    if (ratio >= 1) {
+                        // the data point at y is optimal
+                        result.converged = true;
+                        break;
+                    }
+                    for (std::size_t k = 0;  k < dims;  ++k) {
+                        next[k] = (1 - ratio) * next[k] + ratio * y[k];
+                    }
+                }
+
+                double step2 = 0, norm2 = 0;
+                for (std::size_t k = 0;  k < dims;  ++k) {
+                    step2 += (next[k] - y[k]) * (next[k] - y[k]);
+                    norm2 += next[k] * next[k];
+                }
+                y.swap(next);
+                if (std::sqrt(step2) <= options.tolerance * (1 + std::sqrt(norm2))) {
+                    result.converged = true;
+                    break;
+                }
+            }
+            result.point = std::move(y);
+            return result;
+        }
+    }
+
+    template<std::ranges::input_range Coordinates, executor Executor>
+        requires std::ranges::contiguous_range<std::ranges::range_reference_t<Coordinates>>
+              && std::same_as<std::ranges::range_value_t<std::ranges::range_reference_t<Coordinates>>, double>
+    geometric_median_result geometric_median(Coordinates&& coordinates, Executor& executor,
+                                             geometric_median_options options = {})
+    {
+        auto const [columns, n] = geometric_detail::columns_of(std::forward<Coordinates>(coordinates));
+        return geometric_detail::solve(columns, n, executor, options);
+    }
+
+    template<std::ranges::input_range Coordinates>
+        requires std::ranges::contiguous_range<std::ranges::range_reference_t<Coordinates>>
+              && std::same_as<std::ranges::range_value_t<std::ranges::range_reference_t<Coordinates>>, double>
+    geometric_median_result geometric_median(Coordinates&& coordinates, geometric_median_options options = {})
+    {
+        auto const [columns, n] = geometric_detail::columns_of(std::forward<Coordinates>(coordinates));
+        auto const limit = options.threads ? options.threads : std::max(std::thread::hardware_concurrency(), 1u);
+        auto const threads = geometric_detail::useful_threads(n, limit, options);
+        if (threads > 1) {
+            thread_pool pool{static_cast<unsigned>(threads - 1)};
+            return geometric_detail::solve(columns, n, pool, options);
+        }
+        geometric_detail::serial_executor serial;
+        return geometric_detail::solve(columns, n, serial, options);
+    }
+}
+
+#endif
@@ -1,9 +1,18 @@
 #include "median.hh"
+#include "../thread-pool/pool.hh"
 
 #include <gtest/gtest.h>
+#include "../alloc-count/alloc-count.hh"
+
 #include <array>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
 #include <forward_list>
+#include <numeric>
+#include <random>
 #include <stdexcept>
+#include <utility>
 #include <vector>
 
 namespace test
@@ -98,6 +107,7 @@ enum strategy_mask : unsigned {
     sm_external       = 0x08,
     sm_default        = 0x10,
     sm_frugal         = 0x20,
+    sm_bracket        = 0x40,
 
     sm_none =  0u,
     sm_all  = ~0u,
@@ -123,6 +133,7 @@ void expect_usable(strategy_mask m = 0)
     EXPECT_EQ(is_set(m, sm_external), (strategy_accepts_type<stats::external_strategy, Range>));
     EXPECT_EQ(is_set(m, sm_default), (strategy_accepts_type<stats::default_strategy, Range>));
     EXPECT_EQ(is_set(m, sm_frugal), (strategy_accepts_type<stats::frugal_strategy, Range>));
+    EXPECT_EQ(is_set(m, sm_bracket), (strategy_accepts_type<stats::bracket_strategy, Range>));
 }
 
 // Tests of callability
@@ -155,11 +166,11 @@ TEST(Strategies, MoveOnly)
     // can't be copied
     {
         SCOPED_TRACE("pass by value\n");
-        expect_usable<Range>(sm_all - sm_copy);
+        expect_usable<Range>(sm_all - sm_copy - sm_bracket);
     }
     {
         SCOPED_TRACE("pass by ref\n");
-        expect_usable<Range&>(sm_all - sm_copy - sm_inplace_rvalue);
+        expect_usable<Range&>(sm_all - sm_copy - sm_bracket - sm_inplace_rvalue);
     }
     {
         SCOPED_TRACE("pass by const ref\n");
@@ -167,7 +178,7 @@ TEST(Strategies, MoveOnly)
     }
     {
         SCOPED_TRACE("pass by rvalue\n");
-        expect_usable<Range&&>(sm_all - sm_copy);
+        expect_usable<Range&&>(sm_all - sm_copy - sm_bracket);
     }
 }
 
@@ -176,19 +187,19 @@ TEST(Strategies, NoCopy)
     using Range = std::vector<test::nocopy_int>;
     {
         SCOPED_TRACE("pass by value\n");
-        expect_usable<Range>(sm_all - sm_inplace - sm_copy);
+        expect_usable<Range>(sm_all - sm_inplace - sm_copy - sm_bracket);
     }
     {
         SCOPED_TRACE("pass by ref\n");
-        expect_usable<Range&>(sm_all - sm_inplace - sm_copy);
+        expect_usable<Range&>(sm_all - sm_inplace - sm_copy - sm_bracket);
     }
     {
         SCOPED_TRACE("pass by const ref\n");
-        expect_usable<Range const&>(sm_all - sm_inplace - sm_copy);
+        expect_usable<Range const&>(sm_all - sm_inplace - sm_copy - sm_bracket);
     }
     {
         SCOPED_TRACE("pass by rvalue\n");
-        expect_usable<Range&&>(sm_all - sm_inplace - sm_copy);
+        expect_usable<Range&&>(sm_all - sm_inplace - sm_copy - sm_bracket);
     }
 }
 
@@ -276,6 +287,9 @@ static void test_values_const_input(const Container& values, Midpoint expected,
     test_strategy(m, values, "default strategy");
     test_strategy(m.using_copy_strategy(), values, "copy strategy");
     test_strategy(m.using_external_strategy(), values, "external strategy");
+    if constexpr (std::copyable<std::ranges::range_value_t<Container>>) {
+        test_strategy(m.using_bracket_strategy(), values, "bracket strategy");
+    }
 }
 
 template<std::ranges::forward_range Container = std::vector<int>,
@@ -483,4 +497,362 @@ TEST(Median, FilteredRangeConst)
     EXPECT_EQ(values[2], 1);    // shouldn't have modified underlying range
 }
 
+TEST(Bracket, MatchesCopy)
+{
+    std::mt19937 gen{4};
+    auto const bracket = stats::median.using_arithmetic_midpoint().using_bracket_strategy();
+    auto const copy = stats::median.using_arithmetic_midpoint().using_copy_strategy();
+    for (int range: {3, 100, 1000000}) {
+        std::uniform_int_distribution<int> value{-range, range};
+        for (std::size_t size: {3, 4, 10, 99, 1000, 4096, 100001}) {
+            std::vector<int> values(size);
+            std::ranges::generate(values, [&]{ return value(gen); });
+            EXPECT_EQ(bracket(std::as_const(values)), copy(values))
+                << "size " << size << ", range " << range;
+        }
+    }
+}
+
+TEST(Bracket, Ordered)
+{
+    std::vector<int> values(10000);
+    std::iota(values.begin(), values.end(), 0);
+    auto const bracket = stats::median.using_arithmetic_midpoint().using_bracket_strategy();
+    EXPECT_EQ(bracket(values), 4999.5);
+    std::ranges::reverse(values);
+    EXPECT_EQ(bracket(values), 4999.5);
+    std::ranges::fill(values, 7);
+    EXPECT_EQ(bracket(values), 7);
+}
+
+TEST(Bracket, ForwardList)
+{
+    std::forward_list<double> values;
+    for (int i = 0;  i < 5000;  ++i) {
+        values.push_front(i % 7 * 1.5);
+    }
+    EXPECT_EQ(stats::median.using_bracket_strategy()(values), 4.5);
+}
+
+namespace test
+{
+    // Runs every chunk on the calling thread, so that its allocations are counted,
+    // but claims enough threads to take the parallel path
+    struct serial_executor
+    {
+        std::size_t concurrency() const { return 4; }
+
+        template<typename Body>
+        void parallel_for(std::size_t n, Body&& body, std::size_t)
+        {
+            body(std::size_t{0}, n);
+        }
+    };
+}
+
+TEST(Parallel, MatchesCopy)
+{
+    thread_pool pool{3};
+    std::mt19937 gen{5};
+    auto const parallel = stats::median.using_arithmetic_midpoint().using_executor(pool);
+    auto const copy = stats::median.using_arithmetic_midpoint().using_copy_strategy();
+    for (int range: {3, 1000, 1000000}) {
+        std::uniform_int_distribution<int> value{-range, range};
+        for (std::size_t size: {99, 40000, 100001, 1000000}) {
+            std::vector<int> values(size);
+            std::ranges::generate(values, [&]{ return value(gen); });
+            EXPECT_EQ(parallel(std::as_const(values)), copy(values))
+                << "size " << size << ", range " << range;
+        }
+    }
+}
+
+TEST(Parallel, OrderedAndProjected)
+{
+    thread_pool pool{2};
+    std::vector<std::pair<int, double>> values(100000);
+    for (int i = 0;  i < 100000;  ++i) {
+        values[static_cast<std::size_t>(i)] = {i, -i};
+    }
+    auto const parallel = stats::median.using_arithmetic_midpoint().using_executor(pool);
+    EXPECT_EQ(parallel.using_projection(&std::pair<int, double>::first)(values), 49999.5);
+    EXPECT_EQ(parallel.using_projection(&std::pair<int, double>::second)(values), -49999.5);
+    EXPECT_EQ(parallel.using_compare(std::greater<>{})
+              .using_projection(&std::pair<int, double>::first)(values), 49999.5);
+    EXPECT_EQ(values[3].first, 3);   // input unchanged
+}
+
+TEST(Parallel, DuplicatesNotCopied)
+{
+    test::serial_executor executor;
+    auto const parallel = stats::median.using_arithmetic_midpoint().using_executor(executor);
+    auto const copy = stats::median.using_arithmetic_midpoint().using_copy_strategy();
+    std::vector<int> values(1 << 20, 7);
+    // only the sample and per-slice bookkeeping
+    auto const small = values.size() * sizeof values[0] / 100;
+
+    double result = 0;
+    auto c = alloc_count::during([&]{ result = parallel(std::as_const(values)); });
+    EXPECT_EQ(result, 7);
+    EXPECT_LT(c.bytes, small);
+
+    std::mt19937 gen{6};
+    for (int range: {1, 4}) {
+        std::uniform_int_distribution<int> value{0, range};
+        std::ranges::generate(values, [&]{ return value(gen); });
+        c = alloc_count::during([&]{ result = parallel(std::as_const(values)); });
+        EXPECT_EQ(result, copy(values)) << "range " << range;
+        EXPECT_LT(c.bytes, small) << "range " << range;
+    }
+}
+
+TEST(Allocations, Strategies)
+{
+    std::vector<int> const sorted{1, 2, 3, 4, 5, 6};
+    std::vector<int> const unsorted{6, 1, 5, 2, 4, 3};
+    auto values = unsorted;
+    auto const m = stats::median.using_arithmetic_midpoint();
+
+    EXPECT_NO_ALLOC(m.using_inplace_strategy()(values));
+    EXPECT_NO_ALLOC(m(std::move(values)));
+    // sorted input needs no copy
+    EXPECT_NO_ALLOC(m.using_copy_strategy()(sorted));
+    EXPECT_NO_ALLOC(m.using_external_strategy()(sorted));
+    EXPECT_NO_ALLOC(m(sorted));
+    // otherwise, a single buffer of values or pointers
+    EXPECT_ALLOCATIONS(1, m.using_copy_strategy()(unsorted));
+    EXPECT_ALLOCATIONS(1, m.using_external_strategy()(unsorted));
+    EXPECT_ALLOCATIONS(1, m(unsorted));
+    EXPECT_ALLOCATIONS(1, m.using_frugal_strategy()(unsorted));
+}
+
+TEST(Allocations, Bracket)
+{
+    auto const bracket = stats::median.using_bracket_strategy();
+    std::mt19937 gen{5};
+    for (std::size_t size: {1000, 100000}) {
+        std::vector<int> values(size);
+        std::ranges::generate(values, [&]{ return static_cast<int>(gen()); });
+        // summary blocks of O(√n) values, never an allocation per value
+        auto const c = alloc_count::during([&]{ (void)bracket(values); });
+        EXPECT_LT(static_cast<double>(c.allocations), 4 * std::sqrt(size)) << "size " << size;
+    }
+}
+
+TEST(Sparse, Errors)
+{
+    EXPECT_THROW(stats::median.sparse(std::vector<int>{}, 0, 0), std::invalid_argument);
+    EXPECT_THROW(stats::median.sparse(std::vector{1, 2}, 1, 0), std::invalid_argument);
+}
+
+TEST(Sparse, ImplicitMedian)
+{
+    EXPECT_EQ(stats::median.sparse(std::array{-1, 5}, 1000, 0), 0);
+    EXPECT_EQ(stats::median.sparse(std::vector<int>{}, 4, 7), 7);
+}
+
+TEST(Sparse, ExplicitMedian)
+{
+    // 0 0 0 1 2 3 4 5 6
+    EXPECT_EQ(stats::median.sparse(std::array{6, 1, 5, 2, 4, 3}, 9, 0), 2);
+    // 1 2 3 3 4 5 6 9 9 9
+    EXPECT_EQ(stats::median.using_arithmetic_midpoint()
+              .sparse(std::array{6, 1, 5, 2, 4, 3, 3}, 10, 9), 4.5);
+    // no implicit elements at all
+    EXPECT_EQ(stats::median.sparse(std::array{3, 1, 2}, 3, 100), 2);
+}
+
+TEST(Sparse, StraddlesImplicit)
+{
+    // -2 -1 0 0 5 6: midpoint of 0 and 0
+    EXPECT_EQ(stats::median.using_arithmetic_midpoint().sparse(std::array{5, -1, 6, -2}, 6, 0), 0);
+    // -2 0 0 5 6 7: midpoint of 0 and 5
+    EXPECT_EQ(stats::median.using_arithmetic_midpoint().sparse(std::array{5, -2, 6, 7}, 6, 0), 2.5);
+    // -7 -6 -5 0 0 2: midpoint of -5 and 0
+    EXPECT_EQ(stats::median.using_arithmetic_midpoint().sparse(std::array{-5, -6, 2, -7}, 6, 0), -2.5);
+}
+
+TEST(Sparse, EntriesWithProjection)
+{
+    using entry = std::pair<std::size_t, double>;
+    auto const entries = std::vector<entry>{{3, 1.5}, {10, -2.0}, {11, 4.0}, {90, 8.0}};
+    auto const m = stats::median.using_projection(&entry::second);
+    // 96 zeros
+    EXPECT_EQ(m.sparse(entries, 100, 0.0), 0.0);
+    // -2 1.5 4 8, with one implicit 0 at rank 1
+    EXPECT_EQ(m.sparse(entries, 5, 0.0), 1.5);
+    // -2 0 0 1.5 4 8
+    EXPECT_EQ(m.sparse(entries, 6, 0.0), 0.75);
+}
+
+TEST(Sparse, CustomOrder)
+{
+    // descending: 9 8 0 0 0 -1
+    auto const m = stats::median.using_compare(std::greater<>{}).using_arithmetic_midpoint();
+    EXPECT_EQ(m.sparse(std::array{-1, 8, 9}, 6, 0), 0);
+    // descending: 9 8 7 0 0 -1
+    EXPECT_EQ(m.sparse(std::array{-1, 8, 9, 7}, 6, 0), 3.5);
+}
+
+TEST(Sparse, NaN)
+{
+    constexpr auto nan = std::numeric_limits<double>::quiet_NaN();
+    EXPECT_TRUE(std::isnan(stats::median.sparse(std::array{1.0, nan}, 10, 0.0)));
+    EXPECT_TRUE(std::isnan(stats::median.sparse(std::array{1.0, 2.0}, 10, nan)));
+    EXPECT_EQ(stats::median.sparse(std::array{1.0, 2.0, 3.0}, 3, nan), 2.0);
+}
+
+TEST(Sparse, MatchesDense)
+{
+    std::mt19937 gen{1};
+    std::uniform_int_distribution<int> value{-5, 5};
+    for (std::size_t size = 1;  size < 12;  ++size) {
+        for (std::size_t explicit_count = 0;  explicit_count <= size;  ++explicit_count) {
+            for (int implicit: {-3, 0, 3}) {
+                std::vector<int> entries(explicit_count);
+                std::ranges::generate(entries, [&]{ return value(gen); });
+                auto dense = entries;
+                dense.resize(size, implicit);
+                auto const m = stats::median.using_arithmetic_midpoint();
+                EXPECT_EQ(m.sparse(entries, size, implicit), m(dense))
+                    << "size " << size << ", explicit " << explicit_count << ", implicit " << implicit;
+            }
+        }
+    }
+}
+
+TEST(Dictionary, Errors)
+{
+    auto const dictionary = std::array{10, 20, 30};
+    EXPECT_THROW(stats::median.dictionary(dictionary, std::vector<std::uint8_t>{}), std::invalid_argument);
+    EXPECT_THROW(stats::median.dictionary(dictionary, std::vector<std::uint8_t>{0, 3}), std::out_of_range);
+    EXPECT_THROW(stats::median.dictionary(dictionary, std::vector<std::uint16_t>{0, 300}), std::out_of_range);
+    EXPECT_THROW(stats::median.dictionary(dictionary, std::vector<std::uint32_t>{0, 3}), std::out_of_range);
+}
+
+TEST(Dictionary, Codes)
+{
+    auto const dictionary = std::array{10, 20, 30, 40};
+    auto const m = stats::median.using_arithmetic_midpoint();
+    EXPECT_EQ(m.dictionary(dictionary, std::array<std::uint8_t, 1>{3}), 40);
+    EXPECT_EQ(m.dictionary(dictionary, std::array<std::uint8_t, 3>{3, 0, 1}), 20);
+    EXPECT_EQ(m.dictionary(dictionary, std::array<std::uint8_t, 4>{3, 0, 1, 3}), 30);
+    EXPECT_EQ(m.dictionary(dictionary, std::array<std::uint16_t, 4>{2, 2, 2, 0}), 30);
+    EXPECT_EQ(m.dictionary(dictionary, std::array<std::uint64_t, 2>{0, 3}), 25);
+}
+
+TEST(Dictionary, HistogramSizedByCodes)
+{
+    std::vector<int> dictionary(60000);
+    std::iota(dictionary.begin(), dictionary.end(), 0);
+    std::vector<std::uint16_t> const codes{5, 3, 9, 300, 7};
+    int result = 0;
+    auto const c = alloc_count::during([&]{ result = stats::median.dictionary(dictionary, codes); });
+    EXPECT_EQ(result, 7);
+    EXPECT_LE(c.bytes, 301 * sizeof (std::size_t));
+}
+
+TEST(Dictionary, CustomOrderAndProjection)
+{
+    // dictionary is in the engine's order, not the natural one
+    auto const dictionary = std::array{"ccc", "bb", "a"};
+    auto const m = stats::median.using_projection([](const char *s){ return std::strlen(s); })
+        .using_compare(std::greater<>{});
+    EXPECT_EQ(m.dictionary(dictionary, std::array<std::uint8_t, 3>{2, 0, 1}), 2u);
+}
+
+TEST(Dictionary, NaN)
+{
+    constexpr auto nan = std::numeric_limits<double>::quiet_NaN();
+    auto const dictionary = std::array{1.0, 2.0, nan};
+    EXPECT_EQ(stats::median.dictionary(dictionary, std::array<std::uint8_t, 3>{0, 1, 1}), 2.0);
+    EXPECT_TRUE(std::isnan(stats::median.dictionary(dictionary, std::array<std::uint8_t, 3>{0, 1, 2})));
+}
+
+TEST(Dictionary, MatchesDecoded)
+{
+    std::mt19937 gen{2};
+    auto const dictionary = std::array{-4, -1, 0, 2, 3, 7, 8, 100};
+    std::uniform_int_distribution<int> code{0, dictionary.size() - 1};
+    for (std::size_t size = 1;  size < 40;  ++size) {
+        std::vector<std::uint8_t> codes(size);
+        std::ranges::generate(codes, [&]{ return static_cast<std::uint8_t>(code(gen)); });
+        std::vector<int> decoded;
+        for (auto c: codes) {
+            decoded.push_back(dictionary[c]);
+        }
+        auto const m = stats::median.using_arithmetic_midpoint();
+        EXPECT_EQ(m.dictionary(dictionary, codes), m(decoded)) << "size " << size;
+    }
+}
+
+TEST(RunLength, Errors)
+{
+    EXPECT_THROW(stats::median.run_length(std::vector<int>{}, std::vector<int>{}), std::invalid_argument);
+    EXPECT_THROW(stats::median.run_length(std::array{1, 2}, std::array{0, 0}), std::invalid_argument);
+    EXPECT_THROW(stats::median.run_length(std::array{1, 2}, std::array{1}), std::invalid_argument);
+    EXPECT_THROW(stats::median.run_length(std::array{1, 2}, std::array{1, 1, 1}), std::invalid_argument);
+    EXPECT_THROW(stats::median.run_length(std::array{1, 2}, std::array{1, -1}), std::invalid_argument);
+}
+
+TEST(RunLength, Runs)
+{
+    auto const m = stats::median.using_arithmetic_midpoint();
+    EXPECT_EQ(m.run_length(std::array{7, 3}, std::array{2, 3}), 3);
+    EXPECT_EQ(m.run_length(std::array{7, 3}, std::array{3, 3}), 5);
+    EXPECT_EQ(m.run_length(std::array{7, 3, 5}, std::array{1000000, 999999, 1}), 6);
+    EXPECT_EQ(m.run_length(std::array{7, 3, 5}, std::array{1, 0, 1}), 6);
+    EXPECT_EQ(m.run_length(std::forward_list{4, 1, 4}, std::array{1u, 5u, 1u}), 1);
+}
+
+TEST(RunLength, NaN)
+{
+    constexpr auto nan = std::numeric_limits<double>::quiet_NaN();
+    EXPECT_EQ(stats::median.run_length(std::array{1.0, nan}, std::array{3, 0}), 1.0);
+    EXPECT_TRUE(std::isnan(stats::median.run_length(std::array{1.0, nan}, std::array{3, 1})));
+}
+
+TEST(RunLength, MatchesDecoded)
+{
+    std::mt19937 gen{3};
+    std::uniform_int_distribution<int> value{-5, 5};
+    std::uniform_int_distribution<int> length{0, 4};
+    for (std::size_t runs = 1;  runs < 30;  ++runs) {
+        std::vector<int> values(runs);
+        std::vector<int> lengths(runs);
+        std::ranges::generate(values, [&]{ return value(gen); });
+        std::ranges::generate(lengths, [&]{ return length(gen); });
+        lengths[0] = 1;
+        std::vector<int> decoded;
+        for (std::size_t i = 0;  i < runs;  ++i) {
+            decoded.insert(decoded.end(), static_cast<std::size_t>(lengths[i]), values[i]);
+        }
+        auto const m = stats::median.using_arithmetic_midpoint();
+        EXPECT_EQ(m.run_length(values, lengths), m(decoded)) << "runs " << runs;
+    }
+}
+
+TEST(Projection, MemberPointerGather)
+{
+    struct record
+    {
+        std::array<char, 40> name;
+        double latency;
+        int count;
+    };
+    std::mt19937 gen{2};
+    std::uniform_int_distribution<int> value{-50, 50};
+    for (std::size_t size: {1u, 2u, 3u, 4u, 5u, 8u, 9u, 100u, 101u}) {
+        std::vector<record> records(size);
+        for (auto& r: records) {
+            r = {{}, value(gen) / 4.0, value(gen)};
+        }
+        auto const by_member = stats::median.using_arithmetic_midpoint().using_copy_strategy();
+        auto const by_lambda = by_member.using_projection([](const record& r){ return r.latency; });
+        EXPECT_EQ(by_member.using_projection(&record::latency)(records), by_lambda(records)) << size;
+        EXPECT_EQ(stats::median.using_projection(&record::count)(std::as_const(records)),
+                  stats::median.using_projection([](const record& r){ return r.count; })(records)) << size;
+    }
+}
+
 #endif
@@ -2,14 +2,22 @@
 #define MEDIAN_H
 
 #include <algorithm>
+#include <array>
+#include <bit>
 #include <cmath>
 #include <concepts>
 #include <functional>
 #include <iterator>
 #include <memory>
 #include <numeric>
+#include <optional>
 #include <ranges>
+#include <span>
+#include <stdexcept>
 #include <utility>
+#include <vector>
+
+#include "../trace/trace.hh"
 
 /*
   A flexible but user-friendly way to evaluate the median of almost any collection.
@@ -28,6 +36,11 @@
   * Other strategies are provided.  The "inplace" strategy is useful to end users, as it treats all
     inputs as rvalues (modifying through references) even without `std::move()`.  The "copy" and
     "external" strategies are mostly useful to the implementation of the default and frugal ones.
+    The "bracket" strategy reads the input in two passes (three if it's not a sized range), using
+    only O(√n log n) memory.
+
+  * stats::median.using_executor(pool) counts and selects large inputs in parallel on an executor
+    such as thread_pool (../thread-pool/pool.hh), without copying or modifying them.
 
   * We can use any comparator or projection function, and any any function to calculate the mean of
     the mid elements (this function will be passed duplicate arguments if the input size is odd).
@@ -36,6 +49,16 @@
     from integer inputs.  For example:
 
         stats::median.using_arithmetic_midpoint()(std::array{ 0, 1, 2, 3})  ⟶  1.5
+
+  * Sparse vectors needn't be expanded; give the explicit entries, the logical size and the value
+    of all the other elements:
+
+        stats::median.sparse(std::array{ -1, 5 }, 1000, 0)  ⟶  0
+
+  * Dictionary-encoded and run-length-encoded values are used without decoding:
+
+        stats::median.dictionary(std::array{ 1.5, 2.5, 4.0 }, std::array<std::uint8_t, 3>{ 2, 0, 2 })  ⟶  4.0
+        stats::median.run_length(std::array{ 7, 3 }, std::array{ 2, 3 })  ⟶  3
  */
 
 namespace stats
@@ -87,6 +110,20 @@ namespace stats
         }
     };
 
+    // The elements of a range, in a vector allocated only once if its size is known in advance.
+    // (std::vector's iterator constructor grows repeatedly when a view yields prvalues, because
+    // their iterators are only input iterators to it.)
+    template<std::ranges::input_range Range>
+    auto to_vector(Range&& values)
+    {
+        std::vector<std::ranges::range_value_t<Range>> v;
+        if constexpr (std::ranges::forward_range<Range> || std::ranges::sized_range<Range>) {
+            v.reserve(static_cast<std::size_t>(std::ranges::distance(values)));
+        }
+        std::ranges::copy(values, std::back_inserter(v));
+        return v;
+    }
+
     // Median policies
     struct presorted_strategy
     {
@@ -103,7 +140,7 @@ namespace stats
             auto const size = std::ranges::distance(values);
             auto const lower = std::next(std::ranges::begin(values), (size - 1) / 2);
             auto const upper = size % 2 ? lower : std::next(lower);
-            return midpoint(proj(*lower), proj(*upper));
+            return midpoint(std::invoke(proj, *lower), std::invoke(proj, *upper));
         }
     };
 
@@ -150,10 +187,46 @@ namespace stats
             -> median_result_t<Range, Proj, Midpoint>
             requires std::copyable<std::remove_reference_t<projected_t<Range, Proj>>>
         {
-            auto projected = values | std::views::transform(proj);
-            auto v = std::vector(std::ranges::begin(projected), std::ranges::end(projected));
-            return inplace_strategy{}(v, compare, std::identity{}, midpoint);
+            if constexpr (member_gather<Range, Proj>) {
+                // Extract the field with a strided copy into uninitialised storage
+                using T = projected_t<Range, Proj>;
+                auto const n = static_cast<std::size_t>(std::ranges::size(values));
+                auto buffer = std::make_unique_for_overwrite<T[]>(n);
+                gather_member(std::ranges::data(values), n, proj, buffer.get());
+                return inplace_strategy{}(std::span{buffer.get(), n}, compare, std::identity{}, midpoint);
+            } else {
+                auto v = to_vector(values | std::views::transform(proj));
+                return inplace_strategy{}(v, compare, std::identity{}, midpoint);
+            }
          }
+
+    private:
+        // A pointer-to-member projection of a contiguous range, whose
+        // field can be copied without construction
+        template<typename Range, typename Proj>
+        static constexpr bool member_gather =
+            std::is_member_object_pointer_v<Proj>
+            && std::ranges::contiguous_range<Range>
+            && std::ranges::sized_range<Range>
+            && std::is_trivially_copyable_v<projected_t<Range, Proj>>
+            && std::is_trivially_default_constructible_v<projected_t<Range, Proj>>;
+
+        // Unrolled so that the loads are independent; with -march=native,
+        // GCC uses gather instructions where they're profitable.
+        template<typename Record, typename Member, typename T>
+        static void gather_member(const Record *src, std::size_t n, Member member, T *dst)
+        {
+            auto const *const end = src + n;
+            for (;  end - src >= 4;  src += 4, dst += 4) {
+                dst[0] = src[0].*member;
+                dst[1] = src[1].*member;
+                dst[2] = src[2].*member;
+                dst[3] = src[3].*member;
+            }
+            while (src != end) {
+                *dst++ = (*src++).*member;
+            }
+        }
     };
 
     struct external_strategy
@@ -169,12 +242,221 @@ namespace stats
             using pointer_traits = std::pointer_traits<pointer_type>;
             auto indirect_project = [proj](auto const* a)->decltype(auto) { return std::invoke(proj, *a); };
 
-            auto pointers = values | std::views::transform(pointer_traits::pointer_to);
-            auto v = std::vector(std::ranges::begin(pointers), std::ranges::end(pointers));
+            auto v = to_vector(values | std::views::transform(pointer_traits::pointer_to));
             return inplace_strategy{}(v, compare, indirect_project, midpoint);
          }
     };
 
+    // A summary of a sequence's distribution, from which we can choose values bracketing any given
+    // rank, in O(√n log n) memory.  Values are collected into sorted blocks; whenever two blocks
+    // have the same weight, they are merged and every other element is dropped (so that each
+    // survivor stands for twice as many values).  Each such merge may shift estimated ranks by up
+    // to the blocks' weight, and we keep the total as a bound on the error.
+    template<typename T, typename Comp>
+    class quantile_summary
+    {
+        Comp compare;
+        std::size_t block_size;
+        std::vector<T> pending = {};                // weight 1, unsorted
+        std::vector<std::vector<T>> levels = {};    // levels[i] has weight 2ⁱ, empty or full
+        std::size_t error = 0;
+        bool odd = false;
+
+    public:
+        quantile_summary(Comp compare, std::size_t block_size)
+            : compare{std::move(compare)},
+              block_size{std::max(block_size, std::size_t{1})}
+        {
+            pending.reserve(this->block_size);
+        }
+
+        void add(T const& value)
+        {
+            pending.push_back(value);
+            if (pending.size() < block_size) {
+                return;
+            }
+            std::ranges::sort(pending, compare);
+            auto block = std::move(pending);
+            pending = {};
+            pending.reserve(block_size);
+            for (std::size_t level = 0;  ;  ++level) {
+                if (level == levels.size()) {
+                    levels.push_back(std::move(block));
+                    return;
+                }
+                if (levels[level].empty()) {
+                    levels[level] = std::move(block);
+                    return;
+                }
+                std::vector<T> merged;
+                merged.reserve(2 * block_size);
+                std::ranges::merge(levels[level], block, std::back_inserter(merged), compare);
+                levels[level].clear();
+                block.clear();
+                // alternate which half we keep, so errors don't accumulate in one direction
+                for (auto i = std::size_t{odd};  i < merged.size();  i += 2) {
+                    block.push_back(std::move(merged[i]));
+                }
+                odd = !odd;
+                error += std::size_t{1} << level;
+            }
+        }
+
+        // Values at (or outside) ranks first and last, or nullopt if the
+        // range of values is unbounded on that side.
+        std::pair<std::optional<T>, std::optional<T>> bracket(std::size_t first, std::size_t last) const
+        {
+            std::vector<std::pair<T, std::size_t>> items;
+            for (auto const& v: pending) {
+                items.emplace_back(v, 1);
+            }
+            for (std::size_t level = 0;  level < levels.size();  ++level) {
+                for (auto const& v: levels[level]) {
+                    items.emplace_back(v, std::size_t{1} << level);
+                }
+            }
+            std::ranges::sort(items, compare, &std::pair<T, std::size_t>::first);
+
+            auto const margin = error + 1;
+            std::pair<std::optional<T>, std::optional<T>> result;
+            std::size_t cumulative = 0;
+            for (auto const& [value, weight]: items) {
+                if (cumulative + margin <= first) {
+                    result.first = value;
+                }
+                cumulative += weight;
+                if (cumulative >= last + margin + 1) {
+                    result.second = value;
+                    break;
+                }
+            }
+            return result;
+        }
+    };
+
+    struct bracket_strategy
+    {
+        // Exact median in O(√n log n) memory, without modifying the input.
+        // Pass one builds a quantile_summary to choose two values that bracket the median; pass
+        // two counts the values outside the brackets and collects those between for selection.
+        // If the brackets miss (e.g. an inconsistent comparator), we repeat within the part of
+        // the range known to contain the median.
+        template<std::ranges::forward_range Range,
+                 std::invocable<std::ranges::range_value_t<Range>> Proj,
+                 projected_strict_weak_order<Range, Proj> Comp,
+                 midpoint_function<Range, Proj> Midpoint>
+        auto operator()(Range&& values, Comp compare, Proj proj, Midpoint midpoint) const
+            -> median_result_t<Range, Proj, Midpoint>
+            requires std::copyable<std::remove_cvref_t<projected_t<Range, Proj>>>
+        {
+            using value_type = std::remove_cvref_t<projected_t<Range, Proj>>;
+            auto const size = static_cast<std::size_t>(std::ranges::distance(values));
+            std::array<std::optional<value_type>, 2> results;
+            std::vector<task<value_type>> tasks{{{}, {}, size, {{{(size - 1) / 2, 0}, {size / 2, 1}}}}};
+
+            while (!tasks.empty()) {
+                auto t = std::move(tasks.back());
+                tasks.pop_back();
+                run(values, compare, proj, t, tasks, results);
+            }
+            return midpoint(*results[0], *results[1]);
+        }
+
+    private:
+        // Find values of given ranks among those strictly between lower and upper
+        template<typename T>
+        struct task
+        {
+            std::optional<T> lower;
+            std::optional<T> upper;
+            std::size_t size;
+            std::vector<std::pair<std::size_t, std::size_t>> ranks;  // (rank, result index)
+        };
+
+        template<typename Range, typename Comp, typename Proj, typename T, std::size_t N>
+        static void run(Range& values, Comp& compare, Proj& proj, task<T> const& t,
+                        std::vector<task<T>>& tasks, std::array<std::optional<T>, N>& results)
+        {
+            auto const in_range = [&](T const& v) {
+                return (!t.lower || compare(*t.lower, v)) && (!t.upper || compare(v, *t.upper));
+            };
+            auto const equivalent = [&](T const& a, T const& b) {
+                return !compare(a, b) && !compare(b, a);
+            };
+            auto const [first, last] = std::ranges::minmax(t.ranks | std::views::keys);
+
+            // Pass one: choose brackets
+            auto const block_size = static_cast<std::size_t>(std::ceil(std::sqrt(static_cast<double>(t.size))));
+            quantile_summary<T, Comp> summary{compare, block_size};
+            for (auto&& element: values) {
+                if (decltype(auto) v = std::invoke(proj, element);  in_range(v)) {
+                    summary.add(v);
+                }
+            }
+            auto const [lower, upper] = summary.bracket(first, last);
+            auto const unbracketed = !lower && !upper;
+
+            // Pass two: count those outside the brackets, and collect those between
+            std::size_t below = 0, at_lower = 0, between = 0, at_upper = 0;
+            auto const capacity = 2 * block_size * (std::bit_width(block_size) + 2);
+            std::vector<T> collected;
+            bool overflow = false;
+            for (auto&& element: values) {
+                decltype(auto) v = std::invoke(proj, element);
+                if (!in_range(v)) {
+                    continue;
+                }
+                if (lower && compare(v, *lower)) {
+                    ++below;
+                } else if (lower && equivalent(v, *lower)) {
+                    ++at_lower;
+                } else if (!upper || compare(v, *upper)) {
+                    ++between;
+                    if (overflow) {
+                        // already counting only
+                    } else if (unbracketed || collected.size() < capacity) {
+                        collected.push_back(v);
+                    } else {
+                        overflow = true;
+                        collected = {};
+                    }
+                } else if (equivalent(v, *upper)) {
+                    ++at_upper;
+                }
+            }
+
+            // Resolve each rank, or make a narrower task for it
+            task<T> below_task{t.lower, lower, below, {}};
+            task<T> between_task{lower, upper, between, {}};
+            task<T> above_task{upper, t.upper, t.size - below - at_lower - between - at_upper, {}};
+            for (auto [rank, index]: t.ranks) {
+                if (rank < below) {
+                    below_task.ranks.emplace_back(rank, index);
+                } else if ((rank -= below) < at_lower) {
+                    results[index] = *lower;
+                } else if ((rank -= at_lower) < between) {
+                    if (overflow) {
+                        between_task.ranks.emplace_back(rank, index);
+                    } else {
+                        auto const nth = collected.begin() + static_cast<std::ptrdiff_t>(rank);
+                        std::ranges::nth_element(collected, nth, compare);
+                        results[index] = *nth;
+                    }
+                } else if ((rank -= between) < at_upper) {
+                    results[index] = *upper;
+                } else {
+                    above_task.ranks.emplace_back(rank - at_upper, index);
+                }
+            }
+            for (auto *next: {&below_task, &between_task, &above_task}) {
+                if (!next->ranks.empty()) {
+                    tasks.push_back(std::move(*next));
+                }
+            }
+        }
+    };
+
     // Policy adaptor
     template<typename Policy>
     struct shortcircuit_sorted
@@ -272,6 +554,144 @@ namespace stats
         }
     };
 
+    // Something that can run a body over chunks of an index range in parallel, such as
+    // thread_pool (in ../thread-pool/pool.hh).
+    template<typename E>
+    concept executor = requires(E& e, void (&body)(std::size_t, std::size_t)) {
+        { e.concurrency() } -> std::convertible_to<std::size_t>;
+        e.parallel_for(std::size_t{}, body, std::size_t{});
+    };
+
+    template<executor Executor>
+    struct parallel_strategy
+    {
+        // The two passes of bracket_strategy, but over slices of the input in parallel, with
+        // brackets chosen from a sample rather than a full summary.  Each slice counts the values
+        // below and at the brackets, and collects those strictly between; the median ranks are
+        // then selected from the collected values.  The input isn't modified or copied, but the comparator and
+        // projection must be safe to call concurrently.  Small inputs (and brackets that miss)
+        // get the default strategy.
+        Executor *executor;
+
+        static constexpr std::size_t min_parallel_size = 1 << 15;
+
+        template<std::ranges::random_access_range Range,
+                 std::invocable<std::ranges::range_value_t<Range>> Proj,
+                 projected_strict_weak_order<Range, Proj> Comp,
+                 midpoint_function<Range, Proj> Midpoint>
+        auto operator()(Range&& values, Comp compare, Proj proj, Midpoint midpoint) const
+            -> median_result_t<Range, Proj, Midpoint>
+            requires std::ranges::sized_range<Range>
+                  && std::copyable<std::remove_cvref_t<projected_t<Range, Proj>>>
+                  && std::invocable<default_strategy, Range, Comp, Proj, Midpoint>
+        {
+            using value_type = std::remove_cvref_t<projected_t<Range, Proj>>;
+            auto const size = static_cast<std::size_t>(std::ranges::size(values));
+            auto const threads = static_cast<std::size_t>(executor->concurrency());
+            if (size < min_parallel_size || threads < 2) {
+                return default_strategy{}(std::forward<Range>(values), compare, proj, midpoint);
+            }
+            auto const begin = std::ranges::begin(values);
+            auto const at = [&](std::size_t i) -> decltype(auto) {
+                return std::invoke(proj, begin[static_cast<std::ptrdiff_t>(i)]);
+            };
+            auto const lower_rank = (size - 1) / 2;
+            auto const upper_rank = size / 2;
+
+            // Brackets from a sample, one value from each of s equal strata (at a scrambled
+            // offset, so that periodic inputs aren't sampled in phase).  The number of samples
+            // below the median has a standard deviation of √s/2, so ±2√s gives a wide margin.
+            auto const samples = static_cast<std::size_t>(4 * std::sqrt(static_cast<double>(size)));
+            auto const stride = size / samples;
+            std::vector<value_type> sample;
+            sample.reserve(samples);
+            for (std::size_t i = 0;  i < samples;  ++i) {
+                auto const offset = (i * 0x9e3779b97f4a7c15u >> 40) % stride;
+                sample.push_back(at(i * stride + offset));
+            }
+            std::ranges::sort(sample, compare);
+            auto const margin = 2 * static_cast<std::size_t>(std::sqrt(static_cast<double>(samples)));
+            auto const position = lower_rank * samples / size;
+            value_type const lower = sample[position > margin ? position - margin : 0];
+            value_type const upper = sample[std::min(position + margin, samples - 1)];
+
+            // Count and collect, a slice per chunk.  Values equivalent to a bracket are only
+            // counted, so that duplicate-heavy inputs aren't copied.
+            struct partial
+            {
+                std::size_t below = 0;
+                std::size_t at_lower = 0;
+                std::size_t at_upper = 0;
+                std::vector<value_type> between = {};
+            };
+            auto const slices = 8 * threads;
+            std::vector<partial> partials(slices);
+            executor->parallel_for(slices, [&](std::size_t first, std::size_t last) {
+                for (auto slice = first;  slice < last;  ++slice) {
+                    auto& p = partials[slice];
+                    for (auto i = slice * size / slices, end = (slice + 1) * size / slices;  i < end;  ++i) {
+                        decltype(auto) v = at(i);
+                        if (compare(v, lower)) {
+                            ++p.below;
+                        } else if (!compare(lower, v)) {
+                            ++p.at_lower;
+                        } else if (compare(v, upper)) {
+                            p.between.push_back(v);
+                        } else if (!compare(upper, v)) {
+                            ++p.at_upper;
+                        }
+                    }
+                }
+            }, 1);
+
+            std::size_t below = 0, at_lower = 0, between = 0, at_upper = 0;
+            for (auto const& p: partials) {
+                below += p.below;
+                at_lower += p.at_lower;
+                between += p.between.size();
+                at_upper += p.at_upper;
+            }
+            if (lower_rank < below || upper_rank >= below + at_lower + between + at_upper) {
+                // unlucky sample, or inconsistent comparator
+                return default_strategy{}(std::forward<Range>(values), compare, proj, midpoint);
+            }
+
+            std::vector<value_type> collected;
+            collected.reserve(between);
+            for (auto& p: partials) {
+                std::ranges::move(p.between, std::back_inserter(collected));
+                p.between = {};
+            }
+
+            // Resolve each rank to a bracket, or select it from those collected
+            auto const first_between = below + at_lower;
+            auto const is_between = [&](std::size_t rank) {
+                return rank >= first_between && rank < first_between + between;
+            };
+            auto const select = [&](std::size_t rank) -> value_type {
+                if (rank < first_between) {
+                    return lower;
+                }
+                if (!is_between(rank)) {
+                    return upper;
+                }
+                auto const nth = collected.begin() + static_cast<std::ptrdiff_t>(rank - first_between);
+                std::ranges::nth_element(collected, nth, compare);
+                return *nth;
+            };
+            value_type const upper_value = select(upper_rank);
+            if (lower_rank == upper_rank) {
+                return midpoint(upper_value, upper_value);
+            }
+            if (is_between(lower_rank) && is_between(upper_rank)) {
+                // already partitioned about the upper rank
+                auto const upper_it = collected.begin() + static_cast<std::ptrdiff_t>(upper_rank - first_between);
+                return midpoint(*std::ranges::max_element(collected.begin(), upper_it, compare), upper_value);
+            }
+            return midpoint(select(lower_rank), upper_value);
+        }
+    };
+
     // The median calculator type
     template<typename Proj, typename Comp, typename Midpoint, typename Strategy>
     class median_engine
@@ -343,6 +763,14 @@ namespace stats
         [[nodiscard]] constexpr auto using_frugal_strategy() const
         { return using_strategy(frugal_strategy{}); }
 
+        [[nodiscard]] constexpr auto using_bracket_strategy() const
+        { return using_strategy(bracket_strategy{}); }
+
+        // The executor must outlive the engine.
+        template<executor E>
+        [[nodiscard]] constexpr auto using_executor(E& executor) const
+        { return using_strategy(parallel_strategy<E>{&executor}); }
+
         // Main function interface:
         // Compute the median of a range of values
         template<std::ranges::forward_range Range>
@@ -367,11 +795,187 @@ namespace stats
             return calculate_median(values_copy);
         }
 
+        // Median of a sparse vector of logical length `size`, whose elements all equal `implicit`
+        // except for the given explicit entries (e.g. (index, value) pairs - use a projection to
+        // select the value).  Only the explicit values are copied and selected; the implicit ones
+        // are counted, not materialised.
+        template<std::ranges::input_range Range>
+        auto sparse(Range&& entries, std::size_t size,
+                    std::remove_cvref_t<projected_t<Range, Proj>> const& implicit) const
+            -> median_result_t<Range, Proj, Midpoint>
+            requires std::copyable<std::remove_cvref_t<projected_t<Range, Proj>>>
+        {
+            using value_type = std::remove_cvref_t<projected_t<Range, Proj>>;
+            if (size == 0) {
+                throw std::invalid_argument("Attempting median of empty range");
+            }
+            auto v = to_vector(entries | std::views::transform(projection));
+            if (v.size() > size) {
+                throw std::invalid_argument("More explicit entries than sparse vector size");
+            }
+            auto const implicit_count = size - v.size();
+
+            // If any value is NaN, there is no meaningful median.
+            if constexpr (std::is_floating_point_v<value_type>) {
+                if (implicit_count && std::isnan(implicit)) {
+                    return midpoint(implicit, implicit);
+                }
+                auto isnan = [](value_type d){ return std::isnan(d); };
+                if (auto it = std::ranges::find_if(v, isnan); it != v.end()) {
+                    return midpoint(*it, *it);
+                }
+            }
+
+            // Explicit values ordered before the implicit block go first;
+            // the block occupies ranks [below, below + implicit_count).
+            auto const rest = std::ranges::partition(v, [&](auto const& x){ return compare(x, implicit); });
+            auto const below = static_cast<std::size_t>(rest.begin() - v.begin());
+            auto const nth = [&](std::size_t rank) -> value_type const& {
+                if (rank < below) {
+                    auto const it = v.begin() + static_cast<std::ptrdiff_t>(rank);
+                    std::ranges::nth_element(v.begin(), it, rest.begin(), compare);
+                    return *it;
+                }
+                if (rank < below + implicit_count) {
+                    return implicit;
+                }
+                auto const it = v.begin() + static_cast<std::ptrdiff_t>(rank - implicit_count);
+                std::ranges::nth_element(rest.begin(), it, v.end(), compare);
+                return *it;
+            };
+
+            auto const lower = (size - 1) / 2;
+            auto const upper = size / 2;
+            if (lower == upper) {
+                auto const& a = nth(lower);
+                return midpoint(a, a);
+            }
+            // copy the lower value, as selecting the upper may move it
+            value_type const a = nth(lower);
+            return midpoint(a, nth(upper));
+        }
+
+        // Median of dictionary-encoded values: each code indexes `dictionary`, which must be
+        // ordered by this engine's comparator (after projection).  The codes are counted, and the
+        // middle ranks found from the cumulative counts, without decoding.
+        template<std::ranges::random_access_range Dict, std::ranges::input_range Codes>
+        auto dictionary(Dict&& dictionary, Codes&& codes) const
+            -> median_result_t<Dict, Proj, Midpoint>
+            requires std::unsigned_integral<std::ranges::range_value_t<Codes>>
+        {
+            auto const counts = code_histogram(static_cast<std::size_t>(std::ranges::distance(dictionary)),
+                                               std::forward<Codes>(codes));
+            auto const size = std::accumulate(counts.begin(), counts.end(), std::size_t{0});
+            if (size == 0) {
+                throw std::invalid_argument("Attempting median of empty range");
+            }
+
+            auto const begin = std::ranges::begin(dictionary);
+            using value_type = std::remove_cvref_t<projected_t<Dict, Proj>>;
+            if constexpr (std::is_floating_point_v<value_type>) {
+                for (std::size_t i = 0;  i < counts.size();  ++i) {
+                    if (counts[i] && std::isnan(project(begin + static_cast<std::ptrdiff_t>(i)))) {
+                        auto const& a = project(begin + static_cast<std::ptrdiff_t>(i));
+                        return midpoint(a, a);
+                    }
+                }
+            }
+
+            // Find the codes at the middle ranks, from the cumulative counts
+            std::size_t code = 0;
+            std::size_t cumulative = counts[0];
+            while (cumulative <= (size - 1) / 2) {
+                cumulative += counts[++code];
+            }
+            auto const lower = code;
+            while (cumulative <= size / 2) {
+                cumulative += counts[++code];
+            }
+            auto const upper = code;
+
+            auto const& a = project(begin + static_cast<std::ptrdiff_t>(lower));
+            auto const& b = project(begin + static_cast<std::ptrdiff_t>(upper));
+            return midpoint(a, b);
+        }
+
+        // Median of run-length-encoded values: `values[i]` is repeated `lengths[i]` times.
+        // Selection is weighted by run length, over the runs themselves.
+        template<std::ranges::input_range Values, std::ranges::input_range Lengths>
+        auto run_length(Values&& values, Lengths&& lengths) const
+            -> median_result_t<Values, Proj, Midpoint>
+            requires std::integral<std::ranges::range_value_t<Lengths>>
+                  && std::copyable<std::remove_cvref_t<projected_t<Values, Proj>>>
+        {
+            using value_type = std::remove_cvref_t<projected_t<Values, Proj>>;
+            struct run { value_type value; std::size_t length; };
+            std::vector<run> runs;
+            std::size_t size = 0;
+            auto l = std::ranges::begin(lengths);
+            for (auto v = std::ranges::begin(values);  v != std::ranges::end(values);  ++v, ++l) {
+                if (l == std::ranges::end(lengths)) {
+                    throw std::invalid_argument("Fewer run lengths than values");
+                }
+                if (*l < 0) {
+                    throw std::invalid_argument("Negative run length");
+                }
+                if (auto const length = static_cast<std::size_t>(*l)) {
+                    runs.push_back({project(v), length});
+                    size += length;
+                }
+            }
+            if (l != std::ranges::end(lengths)) {
+                throw std::invalid_argument("More run lengths than values");
+            }
+            if (size == 0) {
+                throw std::invalid_argument("Attempting median of empty range");
+            }
+
+            if constexpr (std::is_floating_point_v<value_type>) {
+                auto isnan = [](run const& r){ return std::isnan(r.value); };
+                if (auto it = std::ranges::find_if(runs, isnan); it != runs.end()) {
+                    return midpoint(it->value, it->value);
+                }
+            }
+
+            // Quickselect, narrowing to the side containing the rank's run.
+            auto const select = [&](std::size_t rank) -> value_type const& {
+                auto first = runs.begin();
+                auto last = runs.end();
+                for (;;) {
+                    auto const mid = first + (last - first) / 2;
+                    std::ranges::nth_element(first, mid, last, compare, &run::value);
+                    std::size_t before = 0;
+                    for (auto it = first;  it != mid;  ++it) {
+                        before += it->length;
+                    }
+                    if (rank < before) {
+                        last = mid;
+                    } else if (rank < before + mid->length) {
+                        return mid->value;
+                    } else {
+                        rank -= before + mid->length;
+                        first = mid + 1;
+                    }
+                }
+            };
+
+            auto const lower = (size - 1) / 2;
+            auto const upper = size / 2;
+            if (lower == upper) {
+                auto const& a = select(lower);
+                return midpoint(a, a);
+            }
+            // copy the lower value, as selecting the upper may move it
+            value_type const a = select(lower);
+            return midpoint(a, select(upper));
+        }
+
     private:
         template<std::ranges::forward_range Range>
         auto calculate_median(Range&& values) const
             requires std::invocable<Strategy, Range, Comp, Proj, Midpoint>
         {
+            TRACE_SCOPE("stats::median");
             auto const begin = std::ranges::begin(values);
             auto const size = std::ranges::distance(values);
 
@@ -415,6 +1019,60 @@ namespace stats
         {
             return std::invoke(projection, *p);
         }
+
+        // Count of each code, which must be less than dictionary_size.
+        // Narrow codes are counted without range checks, into several
+        // histograms to avoid consecutive increments of the same count.
+        // Wider codes, if they can be read twice, are first scanned for
+        // the largest, to check them and to size the histogram (so that
+        // a few 16-bit codes needn't zero and scan 65536 counts).
+        template<std::ranges::input_range Codes>
+        static std::vector<std::size_t> code_histogram(std::size_t dictionary_size, Codes&& codes)
+        {
+            using code_type = std::ranges::range_value_t<Codes>;
+            auto const out_of_range = []{ return std::out_of_range("Dictionary code out of range"); };
+            std::vector<std::size_t> counts;
+            if constexpr (sizeof (code_type) == 1) {
+                constexpr std::size_t lanes = 4;
+                std::size_t partial[lanes][256] = {};
+                std::size_t i = 0;
+                for (auto const c: codes) {
+                    ++partial[i++ % lanes][c];
+                }
+                counts.assign(256, 0);
+                for (auto const& p: partial) {
+                    std::ranges::transform(counts, p, counts.begin(), std::plus<>{});
+                }
+            } else if constexpr (std::ranges::forward_range<Codes>) {
+                std::size_t size = 0;
+                for (auto const c: codes) {
+                    size = std::max(size, std::size_t{c} + 1);
+                }
+                if (size > dictionary_size) {
+                    throw out_of_range();
+                }
+                counts.assign(size, 0);
+                for (auto const c: codes) {
+                    ++counts[c];
+                }
+            } else {
+                counts.assign(dictionary_size, 0);
+                for (auto const c: codes) {
+                    if (c >= dictionary_size) {
+                        throw out_of_range();
+                    }
+                    ++counts[c];
+                }
+            }
+            if (counts.size() > dictionary_size) {
+                if (std::ranges::any_of(counts.begin() + static_cast<std::ptrdiff_t>(dictionary_size),
+                                        counts.end(), std::identity{})) {
+                    throw out_of_range();
+                }
+                counts.resize(dictionary_size);
+            }
+            return counts;
+        }
     };
 
     // We can put a median engine at the end of an adaptor chain
@@ -0,0 +1,117 @@
+#include "memo.hh"
+
+#include <gtest/gtest.h>
+#include <atomic>
+#include <chrono>
+#include <numeric>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+// A midpoint that counts its calls (i.e. median evaluations)
+struct counting_midpoint
+{
+    std::atomic<int> *calls;
+    std::chrono::milliseconds delay{0};
+
+    double operator()(double a, double b) const
+    {
+        ++*calls;
+        std::this_thread::sleep_for(delay);
+        return (a + b) / 2;
+    }
+};
+
+TEST(MedianCache, Repeat)
+{
+    std::atomic<int> calls = 0;
+    auto const engine = stats::median.using_midpoint(counting_midpoint{&calls});
+    auto cache = stats::make_median_cache<double>(engine, 16);
+
+    std::vector const values{5.0, 1.0, 4.0, 2.0};
+    EXPECT_EQ(cache(values), 3.0);
+    EXPECT_EQ(cache(values), 3.0);
+    EXPECT_EQ(calls, 1);
+
+    // same storage, new contents
+    std::vector other{7.0, 9.0};
+    EXPECT_EQ(cache(other, 1), 8.0);
+    other[1] = 11.0;
+    EXPECT_EQ(cache(other, 1), 8.0);    // stale, as promised
+    EXPECT_EQ(cache(other, 2), 9.0);
+    EXPECT_EQ(calls, 3);
+
+    // a prefix is a different key
+    EXPECT_EQ(cache(std::span{values}.first(3)), 4.0);
+    EXPECT_EQ(calls, 4);
+}
+
+TEST(MedianCache, Bounded)
+{
+    std::atomic<int> calls = 0;
+    auto const engine = stats::median.using_midpoint(counting_midpoint{&calls});
+    auto cache = stats::make_median_cache<double>(engine, 8);
+
+    std::vector<double> values(100);
+    std::iota(values.begin(), values.end(), 0.0);
+    for (std::size_t i = 1;  i <= values.size();  ++i) {
+        EXPECT_EQ(cache(std::span{values}.first(i)), static_cast<double>(i - 1) / 2);
+    }
+    EXPECT_EQ(calls, 100);
+
+    // still correct after eviction
+    for (std::size_t i = 1;  i <= values.size();  ++i) {
+        EXPECT_EQ(cache(std::span{values}.first(i)), static_cast<double>(i - 1) / 2);
+    }
+    // the most recent entry is certainly still there
+    auto const before = calls.load();
+    EXPECT_EQ(cache(values), 49.5);
+    EXPECT_EQ(calls, before);
+}
+
+TEST(MedianCache, Exception)
+{
+    struct throwing_midpoint
+    {
+        bool *fail;
+        double operator()(double a, double b) const
+        {
+            if (*fail) { throw std::runtime_error("midpoint"); }
+            return (a + b) / 2;
+        }
+    };
+    bool fail = true;
+    auto cache = stats::make_median_cache<double>(stats::median.using_midpoint(throwing_midpoint{&fail}));
+    std::vector const values{1.0, 3.0};
+    EXPECT_THROW(cache(values), std::runtime_error);
+    fail = false;
+    EXPECT_EQ(cache(values), 2.0);
+}
+
+TEST(MedianCache, RacingCallersComputeOnce)
+{
+    std::atomic<int> calls = 0;
+    auto const engine = stats::median.using_midpoint(counting_midpoint{&calls, std::chrono::milliseconds{50}});
+    auto cache = stats::make_median_cache<double>(engine);
+
+    std::vector<double> values(10001);
+    std::iota(values.begin(), values.end(), 0.0);
+    std::vector<double> results(8);
+    {
+        std::vector<std::jthread> threads;
+        for (auto& r: results) {
+            threads.emplace_back([&]{ r = cache(values); });
+        }
+    }
+    EXPECT_EQ(calls, 1);
+    for (auto const r: results) {
+        EXPECT_EQ(r, 5000.0);
+    }
+}
+
+TEST(MedianCache, DefaultEngine)
+{
+    stats::median_cache<int> cache;
+    std::array const values{3, 1, 2};
+    EXPECT_EQ(cache(values), 2);
+}
@@ -0,0 +1,201 @@
+#ifndef MEMO_H
+#define MEMO_H
+
+#include "median.hh"
+
+#include <atomic>
+#include <bit>
+#include <cstdint>
+#include <memory>
+#include <ranges>
+#include <span>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+
+/*
+  Memoised median of read-only arrays that are queried repeatedly, perhaps from many threads.
+
+      stats::median_cache<double> cached{stats::median, 256};
+      auto m = cached(reference_data, generation);
+
+  Results are keyed on the array's address, its size and a generation number which the caller
+  must change whenever the contents change (or the storage is reused).  The engine's policies are
+  fixed for each cache, so they are implicitly part of the key.
+
+  The cache has a fixed number of slots, and lookups are lock-free.  When several threads ask
+  for the same uncached median, one computes it while the others wait, so it's evaluated only
+  once.  If every candidate slot is busy being computed, the result is computed but not cached.
+ */
+
+namespace stats
+{
+    template<typename Value, typename Engine = std::remove_const_t<decltype(median)>>
+    class median_cache
+    {
+    public:
+        using result_type = std::invoke_result_t<const Engine&, std::span<const Value>>;
+        static_assert(std::is_trivially_copyable_v<result_type>,
+                      "cached results are read with a seqlock, so must be trivially copyable");
+
+    private:
+        // The slot's state word is (version << 2) | phase.  Readers check that
+        // the version hasn't changed while they read the key and value.
+        enum phase : std::uint64_t { empty, claimed, computing, ready };
+        static constexpr std::uint64_t phase_mask = 3;
+
+        struct slot
+        {
+            std::atomic<std::uint64_t> state = 0;
+            std::atomic<const Value*> data = nullptr;
+            std::atomic<std::size_t> size = 0;
+            std::atomic<std::uint64_t> generation = 0;
+            std::atomic<result_type> value = {};
+        };
+
+        // Number of slots examined for each key
+        static constexpr std::size_t probe_length = 8;
+
+        const Engine engine;
+        std::size_t mask;
+        std::unique_ptr<slot[]> slots;
+
+    public:
+        explicit median_cache(Engine engine = median, std::size_t capacity = 1024)
+            : engine{std::move(engine)},
+              mask{std::bit_ceil(std::max(capacity, probe_length)) - 1},
+              slots{std::make_unique<slot[]>(mask + 1)}
+        {}
+
+        median_cache(const median_cache&) = delete;
+        void operator=(const median_cache&) = delete;
+
+        result_type operator()(std::span<const Value> values, std::uint64_t generation = 0) const
+        {
+            auto const data = values.data();
+            auto const size = values.size();
+            auto const home = hash(data, size, generation);
+
+            for (;;) {
+                slot *victim = nullptr;
+                std::uint64_t victim_state = 0;
+                bool retry = false;
+
+                for (std::size_t i = 0;  i < probe_length && !retry;  ++i) {
+                    auto& s = slots[(home + i) & mask];
+                    auto const state = s.state.load(std::memory_order_acquire);
+                    auto const p = state & phase_mask;
+                    if (p == claimed) {
+                        // key is about to be published - it might be ours
+                        s.state.wait(state, std::memory_order_acquire);
+                        retry = true;
+                        continue;
+                    }
+                    if (p == empty) {
+                        if (!victim || (victim_state & phase_mask) != empty) {
+                            victim = &s;
+                            victim_state = state;
+                        }
+                        continue;
+                    }
+
+                    bool const match = s.data.load(std::memory_order_relaxed) == data
+                        && s.size.load(std::memory_order_relaxed) == size
+                        && s.generation.load(std::memory_order_relaxed) == generation;
+                    auto const value = s.value.load(std::memory_order_relaxed);
+                    std::atomic_thread_fence(std::memory_order_acquire);
+                    if (s.state.load(std::memory_order_relaxed) != state) {
+                        // changed under us
+                        retry = true;
+                        continue;
+                    }
+
+                    if (match && p == ready) {
+                        return value;
+                    }
+                    if (match) {
+                        // another thread is computing it
+                        s.state.wait(state, std::memory_order_acquire);
+                        retry = true;
+                        continue;
+                    }
+                    // evict the first ready entry if there's no empty slot
+                    if (p == ready && !victim) {
+                        victim = &s;
+                        victim_state = state;
+                    }
+                }
+                if (retry) {
+                    continue;
+                }
+
+                if (!victim) {
+                    // every slot is being computed - don't wait for them
+                    return engine(values);
+                }
+                auto const version = (victim_state >> 2) + 1;
+                if (!victim->state.compare_exchange_strong(victim_state, version << 2 | claimed,
+                                                           std::memory_order_acquire)) {
+                    continue;
+                }
+                return compute(*victim, version, values, generation);
+            }
+        }
+
+        // Convenience for any contiguous range of Value
+        template<std::ranges::contiguous_range Range>
+            requires std::same_as<std::remove_cv_t<std::ranges::range_value_t<Range>>, Value>
+        result_type operator()(const Range& values, std::uint64_t generation = 0) const
+        {
+            return (*this)(std::span<const Value>{std::ranges::data(values), std::ranges::size(values)},
+                           generation);
+        }
+
+    private:
+        result_type compute(slot& s, std::uint64_t version, std::span<const Value> values,
+                            std::uint64_t generation) const
+        {
+            // order the claim before the key stores, so a reader can't see the new key with
+            // the old state (and value) - its re-check of the state would then pass
+            std::atomic_thread_fence(std::memory_order_release);
+            s.data.store(values.data(), std::memory_order_relaxed);
+            s.size.store(values.size(), std::memory_order_relaxed);
+            s.generation.store(generation, std::memory_order_relaxed);
+            s.state.store(version << 2 | computing, std::memory_order_release);
+            s.state.notify_all();   // those waiting on the claim can now see the key
+
+            try {
+                auto const result = engine(values);
+                s.value.store(result, std::memory_order_relaxed);
+                s.state.store(version << 2 | ready, std::memory_order_release);
+                s.state.notify_all();
+                return result;
+            } catch (...) {
+                // let a waiting thread try instead
+                s.state.store((version + 1) << 2 | empty, std::memory_order_release);
+                s.state.notify_all();
+                throw;
+            }
+        }
+
+        static std::uint64_t hash(const Value *data, std::size_t size, std::uint64_t generation)
+        {
+            // splitmix64 finaliser over the combined key
+            std::uint64_t h = reinterpret_cast<std::uintptr_t>(data);
+            h ^= std::uint64_t{size} * 0x9e3779b97f4a7c15u;
+            h ^= std::rotl(generation, 32);
+            h ^= h >> 30;  h *= 0xbf58476d1ce4e5b9u;
+            h ^= h >> 27;  h *= 0x94d049bb133111ebu;
+            h ^= h >> 31;
+            return h;
+        }
+    };
+
+    template<typename Value, typename Engine>
+    auto make_median_cache(Engine engine, std::size_t capacity = 1024)
+    {
+        return median_cache<Value, Engine>{std::move(engine), capacity};
+    }
+}
+
+#endif
@@ -0,0 +1,90 @@
+#include "pairwise.hh"
+
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <vector>
+
+/*
+  Time of the pairwise estimators, against materialising all the pairs and using stats::median.
+
+  Usage: pairwise-bench [MAX_SIZE [MAX_NAIVE_SIZE]]
+
+  Sizes double from 128 up to MAX_SIZE (default 1M); the quadratic versions are only run up to
+  MAX_NAIVE_SIZE (default 8192).
+ */
+
+static double naive_hodges_lehmann(std::vector<double> const& x)
+{
+    std::vector<double> averages;
+    averages.reserve(x.size() * (x.size() + 1) / 2);
+    for (std::size_t i = 0;  i < x.size();  ++i) {
+        for (std::size_t j = i;  j < x.size();  ++j) {
+            averages.push_back(std::midpoint(x[i], x[j]));
+        }
+    }
+    return stats::median(std::move(averages));
+}
+
+static double naive_theil_sen(std::vector<double> const& x, std::vector<double> const& y)
+{
+    std::vector<double> slopes;
+    slopes.reserve(x.size() * (x.size() - 1) / 2);
+    for (std::size_t i = 0;  i < x.size();  ++i) {
+        for (std::size_t j = i + 1;  j < x.size();  ++j) {
+            if (x[i] != x[j]) {
+                slopes.push_back((y[j] - y[i]) / (x[j] - x[i]));
+            }
+        }
+    }
+    return stats::median(std::move(slopes));
+}
+
+template<typename F>
+static double seconds(F&& f)
+{
+    auto const start = std::chrono::steady_clock::now();
+    f();
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+int main(int argc, char **argv)
+{
+    std::size_t const max_size = argc > 1 ? std::stoul(argv[1]) : 1 << 20;
+    std::size_t const max_naive = argc > 2 ? std::stoul(argv[2]) : 8192;
+
+    std::mt19937 gen{1};
+    std::normal_distribution<double> noise{0, 1};
+    std::cauchy_distribution<double> outlier{0, 10};
+
+    std::printf("%10s  %14s %14s  %14s %14s\n", "n", "H-L", "H-L naive", "T-S", "T-S naive");
+    for (std::size_t n = 128;  n <= max_size;  n *= 2) {
+        // a noisy line, with heavy-tailed errors
+        std::vector<double> x(n), y(n);
+        for (std::size_t i = 0;  i < n;  ++i) {
+            x[i] = static_cast<double>(i) + noise(gen);
+            y[i] = 3 * x[i] + (i % 10 ? noise(gen) : outlier(gen));
+        }
+
+        double hl = 0, ts = 0;
+        auto const hl_time = seconds([&]{ hl = stats::hodges_lehmann(y); });
+        auto const ts_time = seconds([&]{ ts = stats::theil_sen(x, y); });
+        std::printf("%10zu  %12.6fs ", n, hl_time);
+        if (n <= max_naive) {
+            double naive = 0;
+            auto const t = seconds([&]{ naive = naive_hodges_lehmann(y); });
+            std::printf("%12.6fs%s ", t, naive == hl ? " " : "!");
+        } else {
+            std::printf("%14s ", "");
+        }
+        std::printf(" %12.6fs ", ts_time);
+        if (n <= max_naive) {
+            double naive = 0;
+            auto const t = seconds([&]{ naive = naive_theil_sen(x, y); });
+            std::printf("%12.6fs%s", t, naive == ts ? " " : "!");
+        }
+        std::printf("\n");
+        std::fflush(stdout);
+    }
+}
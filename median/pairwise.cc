@@ -0,0 +1,131 @@
+#include "pairwise.hh"
+
+#include <gtest/gtest.h>
+#include <array>
+#include <cmath>
+#include <random>
+#include <stdexcept>
+#include <vector>
+
+// The quadratic definitions, for comparison
+static double naive_hodges_lehmann(std::vector<double> const& x)
+{
+    std::vector<double> averages;
+    for (std::size_t i = 0;  i < x.size();  ++i) {
+        for (std::size_t j = i;  j < x.size();  ++j) {
+            averages.push_back(std::midpoint(x[i], x[j]));
+        }
+    }
+    return stats::median(std::move(averages));
+}
+
+static double naive_theil_sen(std::vector<double> const& x, std::vector<double> const& y)
+{
+    std::vector<double> slopes;
+    for (std::size_t i = 0;  i < x.size();  ++i) {
+        for (std::size_t j = 0;  j < x.size();  ++j) {
+            if (x[i] < x[j]) {
+                slopes.push_back((y[j] - y[i]) / (x[j] - x[i]));
+            }
+        }
+    }
+    return stats::median(std::move(slopes));
+}
+
+
+TEST(HodgesLehmann, Errors)
+{
+    EXPECT_THROW(stats::hodges_lehmann(std::vector<double>{}), std::invalid_argument);
+}
+
+TEST(HodgesLehmann, Small)
+{
+    EXPECT_EQ(stats::hodges_lehmann(std::array{5}), 5);
+    // averages: 1, 2, 3
+    EXPECT_EQ(stats::hodges_lehmann(std::array{3, 1}), 2);
+    // averages: 0 1 1.5 2 2.5 3 10 11 11.5 20
+    EXPECT_EQ(stats::hodges_lehmann(std::array{0, 2, 3, 20}), 2.75);
+}
+
+TEST(HodgesLehmann, Projection)
+{
+    struct point { int id; double value; };
+    auto const points = std::array{point{1, 3.0}, point{2, 1.0}};
+    EXPECT_EQ(stats::hodges_lehmann(points, &point::value), 2.0);
+}
+
+TEST(HodgesLehmann, NaN)
+{
+    auto const nan = std::numeric_limits<double>::quiet_NaN();
+    EXPECT_TRUE(std::isnan(stats::hodges_lehmann(std::array{1.0, nan, 2.0})));
+}
+
+TEST(HodgesLehmann, MatchesNaive)
+{
+    std::mt19937 gen{1};
+    for (int range: {3, 1000}) {
+        std::uniform_int_distribution<int> value{-range, range};
+        for (std::size_t size: {2, 3, 10, 50, 51, 500}) {
+            std::vector<double> x(size);
+            std::ranges::generate(x, [&]{ return value(gen); });
+            EXPECT_EQ(stats::hodges_lehmann(x), naive_hodges_lehmann(x))
+                << "size " << size << ", range " << range;
+        }
+    }
+}
+
+
+TEST(TheilSen, Errors)
+{
+    EXPECT_THROW(stats::theil_sen(std::array{1, 2}, std::array{1}), std::invalid_argument);
+    EXPECT_THROW(stats::theil_sen(std::array{1, 1}, std::array{1, 2}), std::invalid_argument);
+    EXPECT_THROW(stats::theil_sen(std::vector<int>{}, std::vector<int>{}), std::invalid_argument);
+}
+
+TEST(TheilSen, Line)
+{
+    EXPECT_EQ(stats::theil_sen(std::array{0, 1, 2, 3}, std::array{1, 3, 5, 7}), 2);
+    // one outlier doesn't disturb it
+    EXPECT_EQ(stats::theil_sen(std::array{0, 1, 2, 3, 4}, std::array{1, 3, 500, 7, 9}), 2);
+}
+
+TEST(TheilSen, RepeatedX)
+{
+    // pairs with equal x are ignored: slopes are 1, 1, 3, 3
+    EXPECT_EQ(stats::theil_sen(std::array{0, 0, 1}, std::array{0, 2, 3}), 2);
+}
+
+TEST(TheilSen, NaN)
+{
+    auto const nan = std::numeric_limits<double>::quiet_NaN();
+    EXPECT_TRUE(std::isnan(stats::theil_sen(std::array{1.0, 2.0, 3.0}, std::array{1.0, nan, 2.0})));
+}
+
+TEST(TheilSen, MatchesNaive)
+{
+    std::mt19937 gen{2};
+    for (int range: {3, 1000}) {
+        std::uniform_int_distribution<int> value{-range, range};
+        for (std::size_t size: {2, 3, 10, 50, 51, 500, 2000}) {
+            std::vector<double> x(size), y(size);
+            std::ranges::generate(x, [&]{ return value(gen); });
+            std::ranges::generate(y, [&]{ return value(gen); });
+            if (std::ranges::all_of(x, [&](double d){ return d == x[0]; })) {
+                continue;
+            }
+            EXPECT_EQ(stats::theil_sen(x, y), naive_theil_sen(x, y))
+                << "size " << size << ", range " << range;
+        }
+    }
+}
+
+TEST(TheilSen, ManyEqualSlopes)
+{
+    // collinear points, plus a few off the line
+    std::vector<double> x(3000), y(3000);
+    for (std::size_t i = 0;  i < x.size();  ++i) {
+        x[i] = static_cast<double>(i);
+        y[i] = i % 100 ? 2.0 * x[i] : 0.0;
+    }
+    EXPECT_EQ(stats::theil_sen(x, y), naive_theil_sen(x, y));
+}
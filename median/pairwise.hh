@@ -0,0 +1,316 @@
+#ifndef PAIRWISE_H
+#define PAIRWISE_H
+
+#include "median.hh"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <numeric>
+#include <random>
+#include <ranges>
+#include <span>
+#include <stdexcept>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+/*
+  Robust estimators that are medians over all pairs of values, in O(n log n) expected time and
+  O(n) memory, without materialising the O(n²) pairs.
+
+  * stats::hodges_lehmann(values)       // median of the Walsh averages (xᵢ + xⱼ) / 2, i ≤ j
+
+  * stats::theil_sen(xs, ys)            // median of the slopes (yⱼ - yᵢ) / (xⱼ - xᵢ), xᵢ ≠ xⱼ
+
+  hodges_lehmann() accepts a projection and a midpoint policy as for stats::median, averaging
+  values with arithmetic_midpoint<double> by default.  theil_sen() takes no projection; its
+  midpoint policy (default_midpoint unless given) chooses between the two middle slopes.  The
+  random number generator affects only the running time, never the result.
+ */
+
+namespace stats
+{
+    namespace pairwise_detail
+    {
+        using random_engine = std::mt19937_64;
+
+        template<std::ranges::input_range Range, typename Proj>
+        auto project_sorted(Range&& values, Proj proj)
+        {
+            auto projected = values | std::views::transform(proj);
+            auto v = std::vector(std::ranges::begin(projected), std::ranges::end(projected));
+            std::ranges::sort(v);
+            return v;
+        }
+    }
+
+    // Monahan's algorithm: randomised selection in the implicit upper-triangular matrix of
+    // averages of sorted values, whose rows and columns are both ordered.  Each row keeps the
+    // range of columns still in contention; a random pivot from those is counted against every
+    // row in a single monotone sweep, and the rows are narrowed to the side holding the rank.
+    template<std::ranges::input_range Range,
+             typename Proj = std::identity,
+             typename Midpoint = arithmetic_midpoint<double>>
+    auto hodges_lehmann(Range&& values, Proj proj = {}, Midpoint midpoint = {})
+    {
+        auto const x = pairwise_detail::project_sorted(std::forward<Range>(values), proj);
+        auto const n = x.size();
+        if (n == 0) {
+            throw std::invalid_argument("Attempting Hodges-Lehmann estimate of empty range");
+        }
+        auto const average = [&](std::size_t i, std::size_t j){ return midpoint(x[i], x[j]); };
+        using value_type = decltype(average(0, 0));
+        if constexpr (std::is_floating_point_v<value_type>) {
+            if (std::isnan(average(0, 0)) || std::isnan(average(n - 1, n - 1))) {
+                return std::numeric_limits<value_type>::quiet_NaN();
+            }
+        }
+
+        pairwise_detail::random_engine gen{n};
+        auto const select = [&](std::size_t rank) -> value_type {
+            // row i holds average(i, j) for lower[i] <= j < upper[i]
+            std::vector<std::size_t> lower(n), upper(n, n);
+            std::iota(lower.begin(), lower.end(), std::size_t{0});
+            std::size_t below = 0;          // count of elements known to be left of lower bounds
+            std::size_t active = n * (n + 1) / 2;
+
+            // Per row, the first column in range whose average doesn't satisfy pred(average, p)
+            std::vector<std::size_t> less_bound(n), less_equal_bound(n);
+            auto const partition = [&](value_type p, auto pred, std::vector<std::size_t>& bound) {
+                std::size_t count = below;
+                std::size_t col = n;
+                for (std::size_t i = 0;  i < n;  ++i) {
+                    col = std::max(col, i);
+                    while (col > i && !pred(average(i, col - 1), p)) {
+                        --col;
+                    }
+                    bound[i] = std::clamp(col, lower[i], upper[i]);
+                    count += bound[i] - lower[i];
+                }
+                return count;
+            };
+
+            while (active > n) {
+                // random pivot from the active elements
+                auto k = std::uniform_int_distribution<std::size_t>{0, active - 1}(gen);
+                std::size_t row = 0;
+                while (k >= upper[row] - lower[row]) {
+                    k -= upper[row] - lower[row];
+                    ++row;
+                }
+                auto const pivot = average(row, lower[row] + k);
+
+                auto const less = partition(pivot, std::less<>{}, less_bound);
+                auto const less_equal = partition(pivot, std::less_equal<>{}, less_equal_bound);
+                if (rank < less) {
+                    upper.swap(less_bound);
+                } else if (rank < less_equal) {
+                    return pivot;
+                } else {
+                    lower.swap(less_equal_bound);
+                    below = less_equal;
+                }
+                active = 0;
+                for (std::size_t i = 0;  i < n;  ++i) {
+                    active += upper[i] - lower[i];
+                }
+            }
+
+            std::vector<value_type> remaining;
+            remaining.reserve(active);
+            for (std::size_t i = 0;  i < n;  ++i) {
+                for (auto j = lower[i];  j < upper[i];  ++j) {
+                    remaining.push_back(average(i, j));
+                }
+            }
+            auto const nth = remaining.begin() + static_cast<std::ptrdiff_t>(rank - below);
+            std::ranges::nth_element(remaining, nth);
+            return *nth;
+        };
+
+        auto const pairs = n * (n + 1) / 2;
+        auto const a = select((pairs - 1) / 2);
+        auto const b = pairs % 2 ? a : select(pairs / 2);
+        return midpoint(a, b);
+    }
+
+
+    // Randomised slope selection.  For points ordered by x, a pair's slope is at most t exactly
+    // when the pair is inverted in the order of y - t·x, so the slopes in an interval (lo, hi]
+    // are the pairs ordered differently at lo and at hi, which merge sort counts (or samples, or
+    // lists) in O(n log n).  We sample slopes within the interval to narrow it around the wanted
+    // rank, until few enough remain to list them.
+    template<std::ranges::input_range XRange, std::ranges::input_range YRange,
+             typename Midpoint = default_midpoint>
+    double theil_sen(XRange&& xs, YRange&& ys, Midpoint midpoint = {})
+    {
+        auto const to_double = [](auto const& v){ return static_cast<double>(v); };
+        auto const xv = xs | std::views::transform(to_double);
+        auto const yv = ys | std::views::transform(to_double);
+        std::vector<double> const x(std::ranges::begin(xv), std::ranges::end(xv));
+        std::vector<double> const y(std::ranges::begin(yv), std::ranges::end(yv));
+        if (x.size() != y.size()) {
+            throw std::invalid_argument("Theil-Sen requires equal numbers of x and y values");
+        }
+        if (std::ranges::any_of(x, [](double d){ return std::isnan(d); })
+            || std::ranges::any_of(y, [](double d){ return std::isnan(d); })) {
+            return std::numeric_limits<double>::quiet_NaN();
+        }
+        auto const n = x.size();
+        constexpr auto inf = std::numeric_limits<double>::infinity();
+
+        // Point indices ordered by y - t·x, with ties by descending x (or ascending if strict),
+        // then index.  So a pair with slope exactly t counts as inverted (unless strict), and
+        // pairs with equal x never invert.  Infinite t orders by x (ascending for -∞), then y.
+        auto const order_at = [&](double t, bool strict = false) {
+            std::vector<std::size_t> order(n);
+            std::iota(order.begin(), order.end(), std::size_t{0});
+            if (std::isinf(t)) {
+                auto const sign = t < 0 ? 1.0 : -1.0;
+                std::ranges::sort(order, std::less<>{}, [&](std::size_t i){
+                    return std::tuple{sign * x[i], y[i], i};
+                });
+            } else {
+                auto const tie = strict ? 1.0 : -1.0;
+                std::ranges::sort(order, std::less<>{}, [&](std::size_t i){
+                    return std::tuple{y[i] - t * x[i], tie * x[i], i};
+                });
+            }
+            return order;
+        };
+        auto const slope = [&](std::size_t i, std::size_t j){ return (y[j] - y[i]) / (x[j] - x[i]); };
+
+        // Merge sort `from` into the order of `to`, calling visit(ordinal, lefts, right) for
+        // each element that jumps ahead of lefts, whose pairings with it are the inversions
+        // numbered ordinal onwards.  Returns the number of inversions.
+        auto const inversions = [&](std::vector<std::size_t> const& from,
+                                    std::vector<std::size_t> const& to, auto visit) {
+            std::vector<std::size_t> position(n);
+            for (std::size_t k = 0;  k < n;  ++k) {
+                position[to[k]] = k;
+            }
+            auto seq = from;
+            std::vector<std::size_t> buffer(n);
+            std::size_t count = 0;
+            for (std::size_t width = 1;  width < n;  width *= 2) {
+                for (std::size_t begin = 0;  begin + width < n;  begin += 2 * width) {
+                    auto const mid = begin + width;
+                    auto const end = std::min(begin + 2 * width, n);
+                    auto l = begin, r = mid, out = begin;
+                    while (l < mid && r < end) {
+                        if (position[seq[r]] < position[seq[l]]) {
+                            visit(count, std::span{seq}.subspan(l, mid - l), seq[r]);
+                            count += mid - l;
+                            buffer[out++] = seq[r++];
+                        } else {
+                            buffer[out++] = seq[l++];
+                        }
+                    }
+                    std::copy(seq.begin() + static_cast<std::ptrdiff_t>(l),
+                              seq.begin() + static_cast<std::ptrdiff_t>(mid),
+                              buffer.begin() + static_cast<std::ptrdiff_t>(out));
+                    out += mid - l;
+                    std::copy(seq.begin() + static_cast<std::ptrdiff_t>(r),
+                              seq.begin() + static_cast<std::ptrdiff_t>(end),
+                              buffer.begin() + static_cast<std::ptrdiff_t>(out));
+                    std::copy(buffer.begin() + static_cast<std::ptrdiff_t>(begin),
+                              buffer.begin() + static_cast<std::ptrdiff_t>(end),
+                              seq.begin() + static_cast<std::ptrdiff_t>(begin));
+                }
+            }
+            return count;
+        };
+        auto const ignore = [](std::size_t, std::span<const std::size_t>, std::size_t){};
+
+        auto const bottom = order_at(-inf);
+        auto const total = inversions(bottom, order_at(inf), ignore);
+        if (total == 0) {
+            throw std::invalid_argument("Theil-Sen requires at least two distinct x values");
+        }
+
+        pairwise_detail::random_engine gen{n};
+        auto const list_limit = std::max<std::size_t>(4 * n, 1024);
+        auto const select = [&](std::size_t rank) {
+            // the wanted slope is in (lo, hi]; `below` slopes are ≤ lo, `up_to_hi` are ≤ hi
+            // (only hi and the orderings at lo and hi need be kept)
+            double hi = inf;
+            auto lo_order = bottom, hi_order = order_at(inf);
+            std::size_t below = 0, up_to_hi = total;
+
+            while (up_to_hi - below > list_limit) {
+                auto const active = up_to_hi - below;
+                auto const sample_size = std::min(active, n);
+                std::vector<std::size_t> wanted(sample_size);
+                std::uniform_int_distribution<std::size_t> pick{0, active - 1};
+                std::ranges::generate(wanted, [&]{ return pick(gen); });
+                std::ranges::sort(wanted);
+
+                std::vector<double> sample;
+                sample.reserve(sample_size);
+                auto next = wanted.begin();
+                inversions(lo_order, hi_order, [&](std::size_t ordinal, std::span<const std::size_t> lefts,
+                                                   std::size_t right) {
+                    for (;  next != wanted.end() && *next < ordinal + lefts.size();  ++next) {
+                        auto const left = lefts[*next - ordinal];
+                        sample.push_back(x[left] < x[right] ? slope(left, right) : slope(right, left));
+                    }
+                });
+                std::ranges::sort(sample);
+
+                // bracket the rank's expected position in the sample, with a margin of ~3σ
+                auto const expected = (rank - below) * sample_size / active;
+                auto const margin = static_cast<std::size_t>(3 * std::sqrt(static_cast<double>(sample_size))) + 1;
+                auto const progress = active;
+                if (expected >= margin) {
+                    auto const t = sample[expected - margin];
+                    auto order = order_at(t);
+                    if (auto const count = inversions(bottom, order, ignore);  count <= rank) {
+                        below = count, lo_order = std::move(order);
+                    }
+                }
+                if (expected + margin < sample_size) {
+                    auto const t = sample[expected + margin];
+                    auto order = order_at(t);
+                    if (auto const count = inversions(bottom, order, ignore);  count > rank) {
+                        hi = t, up_to_hi = count, hi_order = std::move(order);
+                    }
+                }
+                if (up_to_hi - below == progress) {
+                    // Stuck, perhaps because many slopes are equal: try the greatest sample
+                    // below hi, or else see whether hi is the answer.
+                    if (auto const it = std::ranges::lower_bound(sample, hi);  it != sample.begin()) {
+                        auto const t = *std::prev(it);
+                        auto order = order_at(t);
+                        if (auto const count = inversions(bottom, order, ignore);  count > rank) {
+                            hi = t, up_to_hi = count, hi_order = std::move(order);
+                        } else {
+                            below = count, lo_order = std::move(order);
+                        }
+                    } else if (inversions(bottom, order_at(hi, true), ignore) <= rank) {
+                        return hi;
+                    }
+                }
+            }
+
+            std::vector<double> remaining;
+            remaining.reserve(up_to_hi - below);
+            inversions(lo_order, hi_order, [&](std::size_t, std::span<const std::size_t> lefts, std::size_t right) {
+                for (auto const left: lefts) {
+                    remaining.push_back(x[left] < x[right] ? slope(left, right) : slope(right, left));
+                }
+            });
+            auto const nth = remaining.begin() + static_cast<std::ptrdiff_t>(rank - below);
+            std::ranges::nth_element(remaining, nth);
+            return *nth;
+        };
+
+        auto const a = select((total - 1) / 2);
+        auto const b = total % 2 ? a : select(total / 2);
+        return midpoint(a, b);
+    }
+}
+
+#endif
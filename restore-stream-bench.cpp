@@ -0,0 +1,136 @@
+#include "restore-stream.hh"
+#include "format-sink.hh"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <iomanip>
+#include <ostream>
+#include <streambuf>
+#include <string>
+#include <thread>
+#include <vector>
+
+/*
+  Cost of a save_stream_state guard, compared with the formatting it protects, and with a
+  format_sink, which needs no guard.
+
+  Usage: restore-stream-bench [ITERATIONS]
+
+  The "eager" guard is the previous implementation, which copies the locale on construction and
+  always imbues it on destruction.  Each test is also run on one stream per hardware thread
+  concurrently, as they all share the global locale's reference count.
+ */
+
+// The previous implementation, for comparison
+template<class CharT, class Traits = typename std::char_traits<CharT>>
+struct eager_save_stream_state
+{
+    std::basic_ios<CharT,Traits>& stream;
+    std::ios_base::fmtflags flags;
+    std::locale locale;
+    std::streamsize precision;
+    std::streamsize width;
+    CharT fill;
+
+    eager_save_stream_state(std::basic_ios<CharT,Traits>& stream)
+        : stream{stream},
+          flags{stream.flags()},
+          locale{stream.getloc()},
+          precision{stream.precision()},
+          width{stream.width()},
+          fill{stream.fill()}
+    {}
+
+    eager_save_stream_state(const eager_save_stream_state&) = delete;
+    void operator=(const eager_save_stream_state&) = delete;
+
+    ~eager_save_stream_state()
+    {
+        stream.flags(flags);
+        stream.imbue(locale);
+        stream.precision(precision);
+        stream.width(width);
+        stream.fill(fill);
+    }
+};
+
+// Discards everything, so that we measure formatting rather than output
+class null_buffer : public std::streambuf
+{
+    char buffer[256];
+protected:
+    int_type overflow(int_type c) override
+    {
+        setp(buffer, buffer + sizeof buffer);
+        return traits_type::not_eof(c);
+    }
+    std::streamsize xsputn(const char *, std::streamsize n) override { return n; }
+};
+
+struct test
+{
+    const char *name;
+    void (*body)(std::ostream&);
+};
+
+static const test tests[] = {
+    { "format only",
+      [](std::ostream& os) { os << std::hex << 123456 << std::dec; } },
+    { "eager guard, no change",
+      [](std::ostream& os) { eager_save_stream_state guard{os}; } },
+    { "eager guard + format",
+      [](std::ostream& os) { eager_save_stream_state guard{os}; os << std::hex << 123456; } },
+    { "guard, no change",
+      [](std::ostream& os) { save_stream_state guard{os}; } },
+    { "guard + format",
+      [](std::ostream& os) { save_stream_state guard{os}; os << std::hex << 123456; } },
+    { "flags+precision guard",
+      [](std::ostream& os) { save_stream_state<char, ss_flags | ss_precision> guard{os}; } },
+    { "complete guard, no change",
+      [](std::ostream& os) {
+          save_stream_state<char, ss_default | ss_exceptions | ss_tie | ss_rdbuf | ss_rdstate> guard{os};
+      } },
+    { "copyfmt save + restore",
+      [](std::ostream& os) { std::ios saved{nullptr}; saved.copyfmt(os); os.copyfmt(saved); } },
+    { "format sink",
+      [](std::ostream& os) { format_sink{os}(123456, {.base = 16}); } },
+    { "guard + imbue",
+      [](std::ostream& os) { save_stream_state guard{os}; os.imbue(std::locale::classic()); } },
+};
+
+static double time_per_iteration(const test& t, unsigned long iterations)
+{
+    null_buffer buf;
+    std::ostream os{&buf};
+    t.body(os);                 // warm up, and create any lazy state
+    auto const start = std::chrono::steady_clock::now();
+    for (auto i = 0ul;  i < iterations;  ++i) {
+        t.body(os);
+    }
+    auto const end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::nano>(end - start).count() / static_cast<double>(iterations);
+}
+
+int main(int argc, char **argv)
+{
+    unsigned long const iterations = argc > 1 ? std::stoul(argv[1]) : 1000000;
+    unsigned const threads = std::max(std::thread::hardware_concurrency(), 1u);
+
+    std::printf("%-26s %12s %12s\n", "", "1 thread", std::to_string(threads).append(" threads").c_str());
+    for (auto const& t: tests) {
+        auto const single = time_per_iteration(t, iterations);
+
+        std::vector<double> results(threads);
+        std::vector<std::thread> workers;
+        for (unsigned i = 0;  i < threads;  ++i) {
+            workers.emplace_back([&t, &results, i, iterations]{ results[i] = time_per_iteration(t, iterations); });
+        }
+        for (auto& w: workers) {
+            w.join();
+        }
+        auto const multi = *std::max_element(results.begin(), results.end());
+
+        std::printf("%-26s %9.1f ns %9.1f ns\n", t.name, single, multi);
+    }
+}
@@ -0,0 +1,88 @@
+#include "restore-stream.hh"
+#include "format-sink.hh"
+
+#include <iomanip>
+#include <sstream>
+
+
+#include <iostream>
+int main()
+{
+    auto test = []() {
+        std::cout << std::setw(15) << "Foo" << ' '
+        << true << ' ' << 123456 << '\n';
+    };
+    {
+        test();
+        const save_stream_state guard{std::cout};
+        std::cout << std::setfill('_') << std::left << std::uppercase
+                  << std::boolalpha << std::hex << std::showbase;
+        test();
+    } // stream restored here
+    test();
+
+
+    std::cout << std::endl;
+
+
+    // Save only the state we change:
+    auto const pi = 3.14159265;
+    std::cout << pi << '\n';
+    {
+        const save_stream_state<char, ss_flags | ss_precision> guard{std::cout};
+        static_assert(sizeof guard < sizeof (save_stream_state<char>));
+        std::cout << std::fixed << std::setprecision(2) << pi << '\n';
+    } // flags and precision restored here
+    std::cout << pi << '\n';
+
+
+    std::cout << std::endl;
+
+
+    // Temporarily redirect a stream, and make it throw on failure:
+    {
+        static const int indent = std::ios_base::xalloc();
+        std::ostringstream capture;
+        const save_stream_state<char, ss_all> guard{std::cout, {indent}};
+        std::cout.rdbuf(capture.rdbuf());
+        std::cout.exceptions(std::ios_base::badbit);
+        std::cout.iword(indent) = 4;
+        std::cout << "captured";
+        std::clog << capture.str() << '\n';
+    } // destination, exceptions and indent restored here
+    std::cout << "not captured\n";
+
+
+    std::cout << std::endl;
+
+
+    // Or leave the stream state alone, and format each value independently:
+    {
+        format_sink out{std::cout};
+        out(pi, {.precision = 2, .floatfield = format_spec::fixed})('\n');
+        out("Foo", {.width = 15, .fill = '_', .adjust = format_spec::left})(' ')
+           (true, {.boolalpha = true})(' ')
+           (123456, {.base = 16, .showbase = true, .uppercase = true})('\n');
+    }
+    test();
+
+
+    std::cout << std::endl;
+
+
+    // Now with wide-character stream:
+    auto wtest = []() {
+        std::wclog << std::setw(15) << L"Foo" << L' '
+        << true << L' ' << 123456 << L'\n';
+    };
+    {
+        wtest();
+        // AAA style initialization - and guard multiple streams
+        auto const guard = { save_stream_state{std::wclog},
+                             save_stream_state{std::wcin} };
+        std::wclog << std::setfill(L'_') << std::left << std::uppercase
+                   << std::boolalpha << std::hex << std::showbase;
+        wtest();
+    } // stream restored here
+    wtest();
+}
@@ -0,0 +1,410 @@
+#include "restore-stream.hh"
+#include "format-sink.hh"
+
+#include <gtest/gtest.h>
+#include "alloc-count/alloc-count.hh"
+
+#include <iomanip>
+#include <cmath>
+#include <cstdint>
+#include <ios>
+#include <limits>
+#include <locale>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace
+{
+    struct comma_decimal : std::numpunct<char>
+    {
+        char do_decimal_point() const override { return ','; }
+    };
+
+    std::locale const classic = std::locale::classic();
+    std::locale const comma{classic, new comma_decimal};
+
+    // Counts the imbue() calls on a stream
+    struct imbue_counter
+    {
+        static inline int count = 0;
+
+        static void callback(std::ios_base::event event, std::ios_base&, int)
+        {
+            if (event == std::ios_base::imbue_event) {
+                ++count;
+            }
+        }
+
+        explicit imbue_counter(std::ios_base& stream)
+        {
+            stream.register_callback(callback, 0);
+            count = 0;
+        }
+    };
+
+    // The stream settings equivalent to a format_spec
+    template<class CharT>
+    void set_format(std::basic_ostream<CharT>& os, const format_spec& spec)
+    {
+        os.flags({});
+        os.setf(spec.adjust == format_spec::left ? std::ios_base::left
+                : spec.adjust == format_spec::internal ? std::ios_base::internal
+                : std::ios_base::right);
+        os.setf(spec.base == 8 ? std::ios_base::oct
+                : spec.base == 16 ? std::ios_base::hex
+                : std::ios_base::dec);
+        switch (spec.floatfield) {
+        case format_spec::general: break;
+        case format_spec::fixed: os.setf(std::ios_base::fixed); break;
+        case format_spec::scientific: os.setf(std::ios_base::scientific); break;
+        case format_spec::hexfloat: os.setf(std::ios_base::fixed | std::ios_base::scientific); break;
+        }
+        if (spec.showbase) { os.setf(std::ios_base::showbase); }
+        if (spec.showpos) { os.setf(std::ios_base::showpos); }
+        if (spec.uppercase) { os.setf(std::ios_base::uppercase); }
+        if (spec.boolalpha) { os.setf(std::ios_base::boolalpha); }
+        os.width(spec.width);
+        os.fill(static_cast<CharT>(spec.fill));
+        os.precision(spec.precision);
+    }
+
+    // Every combination of the settings, at the given precisions
+    std::vector<format_spec> all_specs(std::initializer_list<int> precisions)
+    {
+        std::vector<format_spec> specs;
+        for (int width: {0, 1, 12}) {
+            for (auto adjust: {format_spec::right, format_spec::left, format_spec::internal}) {
+                for (int base: {8, 10, 16}) {
+                    for (int flags = 0;  flags < 16;  ++flags) {
+                        for (int precision: precisions) {
+                            for (auto floatfield: {format_spec::general, format_spec::fixed,
+                                                   format_spec::scientific, format_spec::hexfloat}) {
+                                specs.push_back({
+                                    .width = width, .fill = width == 12 ? '*' : ' ', .adjust = adjust,
+                                    .base = base, .showbase = bool(flags & 1), .showpos = bool(flags & 2),
+                                    .uppercase = bool(flags & 4), .precision = precision,
+                                    .floatfield = floatfield, .boolalpha = bool(flags & 8)});
+                            }
+                        }
+                    }
+                }
+            }
+        }
+        return specs;
+    }
+
+    std::string describe(const format_spec& s)
+    {
+        std::ostringstream os;
+        os << "width " << s.width << ", fill '" << s.fill << "', adjust " << int{s.adjust}
+           << ", base " << s.base << ", showbase " << s.showbase << ", showpos " << s.showpos
+           << ", uppercase " << s.uppercase << ", precision " << s.precision
+           << ", floatfield " << int{s.floatfield} << ", boolalpha " << s.boolalpha;
+        return os.str();
+    }
+
+    // Expect format_sink to write what the stream would
+    template<class CharT, typename T>
+    void expect_like_stream(T value, const std::vector<format_spec>& specs)
+    {
+        for (auto const& spec: specs) {
+            std::basic_ostringstream<CharT> expected, actual;
+            set_format(expected, spec);
+            expected << value;
+            format_sink{actual}(value, spec);
+            EXPECT_EQ(actual.str(), expected.str()) << "value " << testing::PrintToString(value) << ", " << describe(spec);
+            if (actual.str() != expected.str()) {
+                return;         // one failure per value is enough
+            }
+        }
+    }
+}
+
+
+TEST(save_stream_state, restores_formatting)
+{
+    std::ostringstream s;
+    {
+        save_stream_state guard{s};
+        s << std::hex << std::uppercase << std::setfill('*') << std::left
+          << std::setprecision(3) << std::setw(8);
+    }
+    s << std::setw(6) << 255 << 3.14159265;
+    EXPECT_EQ(s.str(), "   2553.14159");
+}
+
+TEST(save_stream_state, selected_fields)
+{
+    std::ostringstream s;
+    {
+        save_stream_state<char, ss_precision> guard{s};
+        s << std::hex << std::setprecision(3);
+    }
+    s << 255 << ' ' << 3.14159265;
+    EXPECT_EQ(s.str(), "ff 3.14159");
+}
+
+TEST(save_stream_state, locale_restored)
+{
+    std::ostringstream s;
+    {
+        save_stream_state guard{s};
+        s.imbue(comma);
+        s << 1.5;
+    }
+    s << ' ' << 1.5;
+    EXPECT_EQ(s.str(), "1,5 1.5");
+    EXPECT_EQ(s.getloc(), classic);
+}
+
+TEST(save_stream_state, unchanged_locale_not_reimbued)
+{
+    std::ostringstream s;
+    s.imbue(comma);
+    imbue_counter imbues{s};
+    {
+        save_stream_state guard{s};
+        s << std::hex;
+    }
+    EXPECT_EQ(imbues.count, 0);
+    {
+        // changed and changed back
+        save_stream_state guard{s};
+        s.imbue(classic);
+        s.imbue(comma);
+    }
+    EXPECT_EQ(imbues.count, 2);
+    EXPECT_EQ(s.getloc(), comma);
+}
+
+TEST(save_stream_state, nested_guards)
+{
+    std::ostringstream s;
+    {
+        save_stream_state outer{s};
+        s.imbue(comma);
+        {
+            save_stream_state inner{s};
+            s.imbue(classic);
+            {
+                save_stream_state innermost{s};
+            }
+            EXPECT_EQ(s.getloc(), classic);
+            s.imbue(comma);
+            s.imbue(classic);
+        }
+        EXPECT_EQ(s.getloc(), comma);
+    }
+    EXPECT_EQ(s.getloc(), classic);
+}
+
+TEST(save_stream_state, locale_history_is_bounded)
+{
+    std::ostringstream s;
+    save_stream_state outer{s};
+    auto const churn = [&]{
+        for (int i = 0;  i < 1000;  ++i) {
+            save_stream_state inner{s};
+            s.imbue(i % 2 ? comma : classic);
+        }
+        for (int i = 0;  i < 1000;  ++i) {
+            s.imbue(i % 2 ? comma : classic);
+        }
+    };
+    churn();
+    // nothing more to remember than the first time round
+    EXPECT_NO_ALLOC(churn());
+}
+
+TEST(save_stream_state, copyfmt_detaches)
+{
+    std::ostringstream s, other;
+    other.imbue(comma);
+    {
+        save_stream_state guard{s};
+        s.copyfmt(other);
+        EXPECT_EQ(s.getloc(), comma);
+    }
+    EXPECT_EQ(s.getloc(), classic);
+
+    // a copy of a guarded stream keeps its own history
+    {
+        save_stream_state guard{other};
+        other.imbue(classic);
+        s.copyfmt(other);
+        {
+            save_stream_state copy_guard{s};
+            s.imbue(comma);
+        }
+        EXPECT_EQ(s.getloc(), classic);
+        s.imbue(comma);
+    }
+    EXPECT_EQ(other.getloc(), comma);
+    EXPECT_EQ(s.getloc(), comma);
+}
+
+TEST(save_stream_state, rdbuf_restored_keeping_state)
+{
+    std::stringbuf direct, capture;
+    std::ostream s{&direct};
+    {
+        save_stream_state<char, ss_rdbuf> guard{s};
+        s.rdbuf(&capture);
+        s << "captured";
+        s.setstate(std::ios_base::eofbit);
+    }
+    EXPECT_EQ(s.rdbuf(), &direct);
+    EXPECT_EQ(s.rdstate(), std::ios_base::eofbit);
+    s.clear();
+    s << "direct";
+    EXPECT_EQ(capture.str(), "captured");
+    EXPECT_EQ(direct.str(), "direct");
+}
+
+TEST(save_stream_state, rdbuf_and_rdstate_restored)
+{
+    std::stringbuf direct, capture;
+    std::ostream s{&direct};
+    {
+        save_stream_state<char, ss_rdbuf | ss_rdstate> guard{s};
+        s.rdbuf(&capture);
+        s.setstate(std::ios_base::failbit);
+    }
+    EXPECT_EQ(s.rdbuf(), &direct);
+    EXPECT_TRUE(s.good());
+}
+
+TEST(save_stream_state, null_rdbuf_restored_without_throwing)
+{
+    std::stringbuf buffer;
+    std::ostream s{nullptr};
+    auto const guarded = [&]{
+        save_stream_state<char, ss_rdbuf> guard{s};
+        s.rdbuf(&buffer);
+        s.exceptions(std::ios_base::badbit);
+    };
+    EXPECT_NO_THROW(guarded());
+    EXPECT_EQ(s.rdbuf(), nullptr);
+    // a stream without a buffer is always bad
+    EXPECT_TRUE(s.bad());
+}
+
+TEST(save_stream_state, exceptions_restored_without_throwing)
+{
+    std::ostringstream s;
+    s.exceptions(std::ios_base::failbit);
+    auto const guarded = [&]{
+        save_stream_state<char, ss_exceptions> guard{s};
+        s.exceptions(std::ios_base::goodbit);
+        s.setstate(std::ios_base::failbit);
+    };
+    EXPECT_NO_THROW(guarded());
+    // the state that would have thrown is kept
+    EXPECT_EQ(s.exceptions(), std::ios_base::failbit);
+    EXPECT_EQ(s.rdstate(), std::ios_base::failbit);
+}
+
+TEST(save_stream_state, everything_restored)
+{
+    static const int index = std::ios_base::xalloc();
+    static const int other_index = std::ios_base::xalloc();
+    std::stringbuf direct, capture;
+    std::ostream s{&direct};
+    std::ostringstream tied;
+    s.exceptions(std::ios_base::badbit);
+    s.iword(index) = 4;
+    s.pword(index) = &tied;
+    auto const guarded = [&]{
+        save_stream_state<char, ss_all> guard{s, {index}};
+        s.rdbuf(&capture);
+        s.exceptions(std::ios_base::goodbit);
+        s.setstate(std::ios_base::badbit);
+        s.tie(&tied);
+        s.iword(index) = 8;
+        s.pword(index) = nullptr;
+        s.iword(other_index) = 1;
+    };
+    EXPECT_NO_THROW(guarded());
+    EXPECT_EQ(s.rdbuf(), &direct);
+    EXPECT_EQ(s.exceptions(), std::ios_base::badbit);
+    EXPECT_TRUE(s.good());
+    EXPECT_EQ(s.tie(), nullptr);
+    EXPECT_EQ(s.iword(index), 4);
+    EXPECT_EQ(s.pword(index), &tied);
+    // only the words asked for
+    EXPECT_EQ(s.iword(other_index), 1);
+}
+
+
+TEST(format_sink, integers_like_stream)
+{
+    auto const specs = all_specs({6});
+    for (int v: {0, 1, -1, 42, -255, std::numeric_limits<int>::min(), std::numeric_limits<int>::max()}) {
+        expect_like_stream<char>(v, specs);
+    }
+    for (long long v: {0LL, -1LL, std::numeric_limits<long long>::min(), std::numeric_limits<long long>::max()}) {
+        expect_like_stream<char>(v, specs);
+    }
+    for (unsigned long v: {0UL, 255UL, std::numeric_limits<unsigned long>::max()}) {
+        expect_like_stream<char>(v, specs);
+    }
+    expect_like_stream<char>(std::int16_t{-300}, specs);
+    expect_like_stream<char>(std::uint16_t{65535}, specs);
+}
+
+TEST(format_sink, floating_point_like_stream)
+{
+    auto const specs = all_specs({0, 1, 3, 6, 17});
+    auto const inf = std::numeric_limits<double>::infinity();
+    for (double v: {0.0, -0.0, 1.0, -1.5, 3.14159265358979, 0.1, 1e-5, 123456789.0, 1e21, -2.5e-300,
+                    std::numeric_limits<double>::max(), std::numeric_limits<double>::denorm_min(),
+                    inf, -inf}) {
+        expect_like_stream<char>(v, specs);
+    }
+    for (float v: {0.0f, 0.1f, -3.25f, 1e30f}) {
+        expect_like_stream<char>(v, specs);
+    }
+}
+
+TEST(format_sink, bool_char_and_strings_like_stream)
+{
+    auto const specs = all_specs({6});
+    expect_like_stream<char>(true, specs);
+    expect_like_stream<char>(false, specs);
+    expect_like_stream<char>('x', specs);
+    expect_like_stream<char>("", specs);
+    expect_like_stream<char>("text", specs);
+    expect_like_stream<char>(std::string{"-42"}, specs);
+}
+
+TEST(format_sink, wide_like_stream)
+{
+    auto const specs = all_specs({3});
+    expect_like_stream<wchar_t>(-255, specs);
+    expect_like_stream<wchar_t>(3.14159265358979, specs);
+    expect_like_stream<wchar_t>(true, specs);
+    expect_like_stream<wchar_t>(L'x', specs);
+    expect_like_stream<wchar_t>(L"text", specs);
+}
+
+TEST(format_sink, long_values_and_padding)
+{
+    std::ostringstream expected, actual;
+    expected << std::fixed << std::setprecision(20) << 1e300 << std::setw(200) << std::left << 'x' << '|';
+    format_sink{actual}(1e300, {.precision = 20, .floatfield = format_spec::fixed})
+        ('x', {.width = 200, .adjust = format_spec::left})('|');
+    EXPECT_EQ(actual.str(), expected.str());
+}
+
+TEST(format_sink, leaves_stream_state_alone)
+{
+    std::ostringstream s;
+    s << std::hex << std::setfill('*');
+    s.width(5);
+    format_sink{s}(255, {.width = 6, .base = 10});
+    EXPECT_EQ(s.flags() & std::ios_base::basefield, std::ios_base::hex);
+    EXPECT_EQ(s.fill(), '*');
+    EXPECT_EQ(s.width(), 5);
+    EXPECT_EQ(s.str(), "   255");
+}
@@ -0,0 +1,356 @@
+#ifndef RESTORE_STREAM_H
+#define RESTORE_STREAM_H
+
+#include <initializer_list>
+#include <ios>
+#include <locale>
+#include <ostream>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// The locales imbued into a stream while any save_stream_state is
+// guarding it, so that guards needn't copy the locale themselves.
+// Only the locales in force when live guards were created are kept, so
+// the history is no longer than the number of guards (plus one).
+// Owned jointly by the stream (via pword) and the active guards.
+// Like the stream itself, this is not safe for concurrent use.
+class stream_locale_history
+{
+    struct entry
+    {
+        std::locale locale;
+        unsigned guards;        // entered at this locale, and still alive
+    };
+
+    // history.back() is the stream's current locale
+    std::vector<entry> history;
+    unsigned guards = 0;
+    // the stream has been destroyed, or copyfmt() replaced its locale
+    bool detached = false;
+
+    explicit stream_locale_history(std::locale current)
+        : history{{std::move(current), 0}}
+    {}
+
+public:
+    stream_locale_history(const stream_locale_history&) = delete;
+    void operator=(const stream_locale_history&) = delete;
+
+    // The history for this stream, created when first needed
+    static stream_locale_history& of(std::ios_base& stream)
+    {
+        static const int index = std::ios_base::xalloc();
+        // iword records whether we've registered our callback
+        // (copyfmt() copies both the callbacks and the iword)
+        auto& registered = stream.iword(index);
+        if (!registered) {
+            stream.register_callback(callback, index);
+            registered = 1;
+        }
+        auto& p = stream.pword(index);
+        if (!p) {
+            p = new stream_locale_history{stream.getloc()};
+        }
+        return *static_cast<stream_locale_history*>(p);
+    }
+
+    // Called by guards
+    std::size_t enter()
+    {
+        // room for the next imbue(), as the callback mustn't throw
+        if (history.size() == history.capacity()) {
+            history.reserve(2 * history.size());
+        }
+        ++guards;
+        ++history.back().guards;
+        return history.size() - 1;
+    }
+
+    // True if the stream's locale might differ from what it was at entry
+    bool changed_since(std::size_t entry) const noexcept
+    {
+        return detached
+            || (entry + 1 != history.size() && !(history[entry].locale == history.back().locale));
+    }
+
+    const std::locale& at(std::size_t entry) const noexcept
+    {
+        return history[entry].locale;
+    }
+
+    void leave(std::size_t entry) noexcept
+    {
+        --history[entry].guards;
+        if (!--guards && detached) {
+            delete this;
+            return;
+        }
+        if (history.size() > 1) {
+            trim();
+        }
+    }
+
+private:
+    // Forget locales that no guard will restore
+    void trim() noexcept
+    {
+        while (history.size() > 1 && !history.back().guards && !history.end()[-2].guards) {
+            history.end()[-2].locale = history.back().locale;
+            history.pop_back();
+        }
+    }
+
+    static void callback(std::ios_base::event event, std::ios_base& stream, int index)
+    {
+        auto& p = stream.pword(index);
+        auto *const h = static_cast<stream_locale_history*>(p);
+        switch (event) {
+        case std::ios_base::imbue_event:
+            if (h) {
+                if (h->history.back().guards) {
+                    // capacity reserved by enter()
+                    h->history.push_back({stream.getloc(), 0});
+                } else {
+                    h->history.back().locale = stream.getloc();
+                }
+            }
+            break;
+        case std::ios_base::erase_event:
+            // stream being destroyed, or about to copyfmt()
+            if (h) {
+                h->detached = true;
+                if (!h->guards) {
+                    delete h;
+                }
+            }
+            break;
+        case std::ios_base::copyfmt_event:
+            // we have the source's pointer; start our own history when needed
+            p = nullptr;
+            break;
+        }
+    }
+};
+
+
+// The locale saved by a save_stream_state.  It isn't copied; instead,
+// the stream's imbue() calls are tracked so that it's restored only if
+// it was actually changed.
+class saved_locale
+{
+    stream_locale_history& history;
+    std::size_t entry;
+
+public:
+    bool restore = true;
+
+    explicit saved_locale(std::ios_base& stream)
+        : history{stream_locale_history::of(stream)},
+          entry{history.enter()}
+    {}
+
+    saved_locale(const saved_locale&) = delete;
+    void operator=(const saved_locale&) = delete;
+
+    ~saved_locale()
+    {
+        history.leave(entry);
+    }
+
+    template<class CharT, class Traits>
+    void restore_to(std::basic_ios<CharT,Traits>& stream) const
+    {
+        if (restore && history.changed_since(entry)) {
+            // copy, as imbue() will add to the history
+            auto const locale = history.at(entry);
+            if (!(stream.getloc() == locale)) {
+                stream.imbue(locale);
+            }
+        }
+    }
+};
+
+
+// The iword() and pword() values at the given indices.  Unlike
+// copyfmt(), this touches only the words we ask for, and doesn't fire
+// any callbacks.
+class saved_words
+{
+    struct word
+    {
+        int index;
+        long iword;
+        void *pword;
+    };
+    std::vector<word> words;
+
+public:
+    saved_words(std::ios_base& stream, std::initializer_list<int> indices)
+        : words{}
+    {
+        words.reserve(indices.size());
+        for (auto const i: indices) {
+            words.push_back({i, stream.iword(i), stream.pword(i)});
+        }
+    }
+
+    void restore_to(std::ios_base& stream) const
+    {
+        for (auto const& w: words) {
+            if (auto& i = stream.iword(w.index);  i != w.iword) {
+                i = w.iword;
+            }
+            if (auto& p = stream.pword(w.index);  p != w.pword) {
+                p = w.pword;
+            }
+        }
+    }
+};
+
+
+// Selects which parts of the state a save_stream_state saves and restores.
+enum stream_state_mask : unsigned {
+    ss_flags      = 0x001,
+    ss_precision  = 0x002,
+    ss_width      = 0x004,
+    ss_fill       = 0x008,
+    ss_locale     = 0x010,
+    // not saved by default
+    ss_exceptions = 0x020,
+    ss_tie        = 0x040,
+    ss_rdbuf      = 0x080,
+    ss_rdstate    = 0x100,
+    ss_words      = 0x200,  // iword() and pword() at indices given to constructor
+
+    ss_none    = 0u,
+    ss_default = ss_flags | ss_precision | ss_width | ss_fill | ss_locale,
+    ss_all     = ss_default | ss_exceptions | ss_tie | ss_rdbuf | ss_rdstate | ss_words,
+};
+
+constexpr auto operator|(stream_state_mask a, stream_state_mask b)
+{ return static_cast<stream_state_mask>(static_cast<unsigned>(a) | static_cast<unsigned>(b)); }
+constexpr bool is_set(stream_state_mask a, stream_state_mask b)
+{ return a & b; }
+
+// Takes no space in a save_stream_state that doesn't save field F
+template<stream_state_mask F>
+struct unsaved_stream_state {};
+
+
+// Members are all public and mutable, so if we really don't want
+// to restore any particular part of the state, we can override.
+//
+// Only the parts selected by Fields are stored and restored, e.g.
+//     save_stream_state<char, ss_flags | ss_precision> guard{std::cout};
+//
+// Saving more than the formatting state is a cheaper alternative to
+// copyfmt(), as only the parts that changed are written back:
+//     save_stream_state<char, ss_all> guard{std::cout, {my_index}};
+// Restoring rdbuf() leaves rdstate() unchanged unless that's saved too.
+// If restoring rdbuf() or rdstate() raises an exception, it's not propagated.
+template<class CharT, stream_state_mask Fields = ss_default,
+         class Traits = typename std::char_traits<CharT>>
+struct save_stream_state
+{
+    template<stream_state_mask F, typename T>
+    using field = std::conditional_t<is_set(Fields, F), T, unsaved_stream_state<F>>;
+
+    std::basic_ios<CharT,Traits>& stream;
+    [[no_unique_address]] field<ss_flags, std::ios_base::fmtflags> flags;
+    [[no_unique_address]] field<ss_locale, saved_locale> locale;
+    [[no_unique_address]] field<ss_precision, std::streamsize> precision;
+    [[no_unique_address]] field<ss_width, std::streamsize> width;
+    [[no_unique_address]] field<ss_fill, CharT> fill;
+    [[no_unique_address]] field<ss_exceptions, std::ios_base::iostate> exceptions;
+    [[no_unique_address]] field<ss_tie, std::basic_ostream<CharT,Traits>*> tie;
+    [[no_unique_address]] field<ss_rdbuf, std::basic_streambuf<CharT,Traits>*> rdbuf;
+    [[no_unique_address]] field<ss_rdstate, std::ios_base::iostate> rdstate;
+    [[no_unique_address]] field<ss_words, saved_words> words;
+
+    save_stream_state(std::basic_ios<CharT,Traits>& stream)
+        : save_stream_state{std::in_place, stream, {}}
+    {}
+
+    save_stream_state(std::basic_ios<CharT,Traits>& stream, std::initializer_list<int> word_indices)
+        requires (is_set(Fields, ss_words))
+        : save_stream_state{std::in_place, stream, word_indices}
+    {}
+
+    // deleting copy construction also prevents move
+    save_stream_state(const save_stream_state&) = delete;
+    void operator=(const save_stream_state&) = delete;
+
+    ~save_stream_state()
+    {
+        if constexpr (is_set(Fields, ss_flags)) { stream.flags(flags); }
+        if constexpr (is_set(Fields, ss_locale)) { locale.restore_to(stream); }
+        if constexpr (is_set(Fields, ss_precision)) { stream.precision(precision); }
+        if constexpr (is_set(Fields, ss_width)) { stream.width(width); }
+        if constexpr (is_set(Fields, ss_fill)) { stream.fill(fill); }
+        if constexpr (is_set(Fields, ss_tie)) {
+            if (stream.tie() != tie) { stream.tie(tie); }
+        }
+        if constexpr (is_set(Fields, ss_rdbuf)) {
+            if (stream.rdbuf() != rdbuf) {
+                auto const state = stream.rdstate();
+                try {
+                    // clears rdstate, so throws if rdbuf is null and badbit is an exception
+                    stream.rdbuf(rdbuf);
+                } catch (std::ios_base::failure&) {
+                }
+                if constexpr (!is_set(Fields, ss_rdstate)) { restore_rdstate(state); }
+            }
+        }
+        if constexpr (is_set(Fields, ss_exceptions)) {
+            if (stream.exceptions() != exceptions) {
+                auto const state = stream.rdstate();
+                stream.clear();       // so that exceptions() doesn't throw
+                stream.exceptions(exceptions);
+                restore_rdstate(state);
+            }
+        }
+        if constexpr (is_set(Fields, ss_rdstate)) { restore_rdstate(rdstate); }
+        if constexpr (is_set(Fields, ss_words)) { words.restore_to(stream); }
+    }
+
+private:
+    save_stream_state(std::in_place_t, std::basic_ios<CharT,Traits>& stream,
+                      std::initializer_list<int> word_indices)
+        : stream{stream},
+          flags{save<ss_flags>([&]{ return stream.flags(); })},
+          locale{save<ss_locale>([&]()->std::ios_base&{ return stream; })},
+          precision{save<ss_precision>([&]{ return stream.precision(); })},
+          width{save<ss_width>([&]{ return stream.width(); })},
+          fill{save<ss_fill>([&]{ return stream.fill(); })},
+          exceptions{save<ss_exceptions>([&]{ return stream.exceptions(); })},
+          tie{save<ss_tie>([&]{ return stream.tie(); })},
+          rdbuf{save<ss_rdbuf>([&]{ return stream.rdbuf(); })},
+          rdstate{save<ss_rdstate>([&]{ return stream.rdstate(); })},
+          words{save<ss_words>([&]{ return saved_words{stream, word_indices}; })}
+    {}
+
+    // clear() sets the state before throwing, so the exception can be ignored
+    void restore_rdstate(std::ios_base::iostate state) noexcept
+    {
+        if (stream.rdstate() != state) {
+            try {
+                stream.clear(state);
+            } catch (std::ios_base::failure&) {
+            }
+        }
+    }
+
+    // The initialiser for field F: the result of get() if it's saved
+    template<stream_state_mask F, typename Get>
+    static decltype(auto) save(Get get)
+    {
+        if constexpr (is_set(Fields, F)) {
+            return get();
+        } else {
+            return unsaved_stream_state<F>{};
+        }
+    }
+};
+
+#endif // RESTORE_STREAM_H
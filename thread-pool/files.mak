@@ -0,0 +1,6 @@
+pool: pool.hh
+USING_GTEST += pool
+
+OPTIMIZED += pool-bench
+pool-bench: pool.hh
+pool-bench: LDLIBS += -pthread
@@ -0,0 +1,76 @@
+#include "pool.hh"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+
+/*
+  Fork-join overhead of thread_pool::parallel_for(), against starting a std::thread per chunk.
+
+  Usage: pool-bench [WORKERS]
+
+  Each parallel_for() has one trivial chunk per thread, so the time is all overhead: forking,
+  stealing, joining, and (after the workers have gone to sleep) waking them.
+ */
+
+using clock_type = std::chrono::steady_clock;
+
+template<typename F>
+static double ns_per_call(F f)
+{
+    constexpr auto min_time = std::chrono::milliseconds{200};
+    f();                        // warm up
+    std::size_t calls = 0;
+    auto const start = clock_type::now();
+    auto end = start;
+    do {
+        f();
+        ++calls;
+        end = clock_type::now();
+    } while (end - start < min_time);
+    return std::chrono::duration<double, std::nano>(end - start).count() / static_cast<double>(calls);
+}
+
+int main(int argc, char **argv)
+{
+    auto const workers = argc > 1 ? static_cast<unsigned>(std::stoul(argv[1])) : thread_pool::default_workers();
+    thread_pool pool{workers};
+    auto const chunks = pool.concurrency();
+    std::atomic<std::size_t> sink = 0;
+    auto const body = [&](std::size_t first, std::size_t last) { sink += last - first; };
+
+    std::printf("%zu threads (including caller)\n", chunks);
+    std::printf("%-32s %10.0f ns\n", "parallel_for, one chunk",
+                ns_per_call([&]{ pool.parallel_for(1, body); }));
+    std::printf("%-32s %10.0f ns\n", "parallel_for, chunk per thread",
+                ns_per_call([&]{ pool.parallel_for(chunks, body, 1); }));
+    std::printf("%-32s %10.0f ns\n", "parallel_for, 64 chunks",
+                ns_per_call([&]{ pool.parallel_for(64, body, 1); }));
+    {
+        // time only the call, not the sleep that lets the workers go idle
+        constexpr int calls = 100;
+        clock_type::duration total{};
+        for (int i = 0;  i < calls;  ++i) {
+            std::this_thread::sleep_for(std::chrono::milliseconds{1});
+            auto const start = clock_type::now();
+            pool.parallel_for(chunks, body, 1);
+            total += clock_type::now() - start;
+        }
+        std::printf("%-32s %10.0f ns\n", "parallel_for, after idle",
+                    std::chrono::duration<double, std::nano>(total).count() / calls);
+    }
+    std::printf("%-32s %10.0f ns\n", "std::thread per chunk",
+                ns_per_call([&]{
+                    std::vector<std::thread> threads;
+                    for (std::size_t i = 1;  i < chunks;  ++i) {
+                        threads.emplace_back(body, i, i + 1);
+                    }
+                    body(0, 1);
+                    for (auto& t: threads) {
+                        t.join();
+                    }
+                }));
+}
@@ -0,0 +1,177 @@
+#include <gtest/gtest.h>
+
+#include "pool.hh"
+
+#include <atomic>
+#include <numeric>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+
+TEST(chase_lev_deque, owner_is_lifo_thieves_fifo)
+{
+    thread_pool_detail::chase_lev_deque<int*> deque{4};
+    int items[100];
+    EXPECT_EQ(deque.pop(), nullptr);
+    EXPECT_EQ(deque.steal(), nullptr);
+
+    // more than the initial capacity, so it must grow
+    for (auto& i: items) {
+        deque.push(&i);
+    }
+    EXPECT_EQ(deque.steal(), &items[0]);
+    EXPECT_EQ(deque.steal(), &items[1]);
+    EXPECT_EQ(deque.pop(), &items[99]);
+    for (int i = 98;  i >= 2;  --i) {
+        EXPECT_EQ(deque.pop(), &items[i]);
+    }
+    EXPECT_TRUE(deque.empty());
+    EXPECT_EQ(deque.pop(), nullptr);
+    EXPECT_EQ(deque.steal(), nullptr);
+}
+
+TEST(chase_lev_deque, each_item_taken_once)
+{
+    constexpr int count = 200000;
+    constexpr int thieves = 3;
+    std::vector<int> items(count);
+    std::vector<std::atomic<int>> taken(count);
+    thread_pool_detail::chase_lev_deque<int*> deque;
+    std::atomic<bool> done = false;
+
+    auto const take = [&](int *p) { ++taken[static_cast<std::size_t>(p - items.data())]; };
+    std::vector<std::thread> threads;
+    for (int i = 0;  i < thieves;  ++i) {
+        threads.emplace_back([&]{
+            while (!done) {
+                if (auto *p = deque.steal()) {
+                    take(p);
+                }
+            }
+        });
+    }
+    // owner alternates pushing a few and popping one
+    for (auto& item: items) {
+        deque.push(&item);
+        if ((&item - items.data()) % 3 == 0) {
+            if (auto *p = deque.pop()) {
+                take(p);
+            }
+        }
+    }
+    while (auto *p = deque.pop()) {
+        take(p);
+    }
+    done = true;
+    for (auto& t: threads) {
+        t.join();
+    }
+    for (auto const& t: taken) {
+        EXPECT_EQ(t, 1);
+    }
+}
+
+
+TEST(thread_pool, covers_each_index_once)
+{
+    thread_pool pool{3};
+    EXPECT_EQ(pool.concurrency(), 4u);
+    for (std::size_t grain: {0, 1, 7, 1000, 200000}) {
+        std::vector<std::atomic<int>> seen(100000);
+        pool.parallel_for(seen.size(), [&](std::size_t first, std::size_t last) {
+            EXPECT_LT(first, last);
+            if (grain) {
+                EXPECT_LE(last - first, grain);
+            }
+            for (auto i = first;  i < last;  ++i) {
+                ++seen[i];
+            }
+        }, grain);
+        for (auto const& s: seen) {
+            ASSERT_EQ(s, 1) << "grain " << grain;
+        }
+    }
+}
+
+TEST(thread_pool, empty_range)
+{
+    thread_pool pool{2};
+    bool called = false;
+    pool.parallel_for(0, [&](std::size_t, std::size_t) { called = true; });
+    EXPECT_FALSE(called);
+}
+
+TEST(thread_pool, no_workers_runs_inline)
+{
+    thread_pool pool{0};
+    EXPECT_EQ(pool.concurrency(), 1u);
+    auto const caller = std::this_thread::get_id();
+    std::size_t total = 0;
+    pool.parallel_for(1000, [&](std::size_t first, std::size_t last) {
+        EXPECT_EQ(std::this_thread::get_id(), caller);
+        total += last - first;
+    }, 10);
+    EXPECT_EQ(total, 1000u);
+}
+
+TEST(thread_pool, nested)
+{
+    thread_pool pool{3};
+    std::atomic<std::size_t> total = 0;
+    pool.parallel_for(50, [&](std::size_t first, std::size_t last) {
+        for (auto i = first;  i < last;  ++i) {
+            pool.parallel_for(i, [&](std::size_t a, std::size_t b) { total += b - a; }, 3);
+        }
+    }, 1);
+    EXPECT_EQ(total, 49u * 50 / 2);
+}
+
+TEST(thread_pool, outside_callers)
+{
+    thread_pool pool{2};
+    std::atomic<std::size_t> total = 0;
+    std::vector<std::thread> callers;
+    for (int i = 0;  i < 4;  ++i) {
+        callers.emplace_back([&]{
+            for (int j = 0;  j < 100;  ++j) {
+                pool.parallel_for(64, [&](std::size_t a, std::size_t b) { total += b - a; }, 1);
+            }
+        });
+    }
+    for (auto& c: callers) {
+        c.join();
+    }
+    EXPECT_EQ(total, 4u * 100 * 64);
+}
+
+TEST(thread_pool, exception_propagates)
+{
+    thread_pool pool{3};
+    auto const fail = [](std::size_t first, std::size_t last) {
+        if (first <= 500 && 500 < last) {
+            throw std::runtime_error("500");
+        }
+    };
+    EXPECT_THROW(pool.parallel_for(1000, fail, 1), std::runtime_error);
+    // and the pool is still usable
+    std::atomic<std::size_t> total = 0;
+    pool.parallel_for(1000, [&](std::size_t a, std::size_t b) { total += b - a; });
+    EXPECT_EQ(total, 1000u);
+}
+
+TEST(thread_pool, affinity)
+{
+    std::atomic<bool> pinned = true;
+    {
+        thread_pool pool{2, {0}};
+        auto const caller = std::this_thread::get_id();
+        pool.parallel_for(10000, [&](std::size_t, std::size_t) {
+            if (std::this_thread::get_id() != caller && sched_getcpu() != 0) {
+                pinned = false;
+            }
+        }, 1);
+    }
+    EXPECT_TRUE(pinned);
+    EXPECT_THROW((thread_pool{1, {-1}}), std::system_error);
+}
@@ -0,0 +1,411 @@
+#ifndef THREAD_POOL_HH
+#define THREAD_POOL_HH
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <system_error>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <pthread.h>
+#include <sched.h>
+
+/*
+  A work-stealing thread pool for fork-join parallelism.
+
+  * thread_pool pool;                     // a worker for each CPU but one
+  * thread_pool pool{3};                  // three workers
+  * thread_pool pool{3, {0, 2, 4}};       // three workers, pinned to CPUs 0, 2 and 4
+
+  * pool.parallel_for(n, [](std::size_t first, std::size_t last){ ... });
+
+  parallel_for() splits [0, n) into chunks of at most `grain` indices (by default, enough for
+  about eight chunks per thread), calls the body for each chunk, and returns when they are all
+  done, rethrowing the first exception thrown by the body.  The calling thread takes part, so a
+  pool with no workers just calls the body inline.  The body may itself call parallel_for() on the
+  same pool; calls from threads outside the pool are serialised.
+
+  Each thread has a Chase-Lev deque.  Splitting a range pushes its upper half onto the splitting
+  thread's deque and continues with the lower half; idle workers steal from the other end, so they
+  take the largest pieces first.  A half that isn't stolen is popped back and run by the thread
+  that pushed it, so splitting costs only a few uncontended atomic operations.  Tasks live on the
+  stack of the thread that forked them, so nothing is allocated per call.
+
+  Idle workers spin briefly before sleeping; forking wakes a sleeper only if there is one.
+ */
+
+namespace thread_pool_detail
+{
+    // A lock-free work-stealing deque (Chase and Lev, 2005, with the memory orderings of Lê et
+    // al., 2013).  The owning thread pushes and pops at the bottom; other threads steal from the
+    // top.  Empty results are T{}.
+    template<typename T>
+    class chase_lev_deque
+    {
+        struct ring
+        {
+            std::int64_t const mask;    // capacity - 1, for a power-of-two capacity
+            std::unique_ptr<std::atomic<T>[]> slots;
+
+            explicit ring(std::int64_t capacity)
+                : mask{capacity - 1},
+                  slots{std::make_unique<std::atomic<T>[]>(static_cast<std::size_t>(capacity))}
+            {}
+
+            T get(std::int64_t i) const
+            {
+                return slots[static_cast<std::size_t>(i & mask)].load(std::memory_order_relaxed);
+            }
+
+            void put(std::int64_t i, T x)
+            {
+                slots[static_cast<std::size_t>(i & mask)].store(x, std::memory_order_relaxed);
+            }
+        };
+
+        // on separate cache lines, as thieves write only top
+        alignas(64) std::atomic<std::int64_t> top = 0;
+        alignas(64) std::atomic<std::int64_t> bottom = 0;
+        std::atomic<ring*> array = nullptr;
+        // Outgrown rings are kept until destruction, as thieves may still be reading them
+        std::vector<std::unique_ptr<ring>> rings = {};
+
+    public:
+        explicit chase_lev_deque(std::int64_t capacity = 64)
+        {
+            rings.push_back(std::make_unique<ring>(std::bit_ceil(static_cast<std::uint64_t>(capacity))));
+            array.store(rings.back().get(), std::memory_order_relaxed);
+        }
+
+        chase_lev_deque(const chase_lev_deque&) = delete;
+        void operator=(const chase_lev_deque&) = delete;
+
+        // Owner only
+        void push(T x)
+        {
+            auto const b = bottom.load(std::memory_order_relaxed);
+            auto const t = top.load(std::memory_order_acquire);
+            auto *a = array.load(std::memory_order_relaxed);
+            if (b - t > a->mask) {
+                a = grow(a, t, b);
+            }
+            a->put(b, x);
+            std::atomic_thread_fence(std::memory_order_release);
+            bottom.store(b + 1, std::memory_order_relaxed);
+        }
+
+        // Owner only: the most recently pushed item
+        T pop()
+        {
+            auto const b = bottom.load(std::memory_order_relaxed) - 1;
+            auto *const a = array.load(std::memory_order_relaxed);
+            bottom.store(b, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            auto t = top.load(std::memory_order_relaxed);
+            if (t > b) {
+                // was empty
+                bottom.store(b + 1, std::memory_order_relaxed);
+                return T{};
+            }
+            auto x = a->get(b);
+            if (t == b) {
+                // the last item - race the thieves for it
+                if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst,
+                                                 std::memory_order_relaxed)) {
+                    x = T{};
+                }
+                bottom.store(b + 1, std::memory_order_relaxed);
+            }
+            return x;
+        }
+
+        // Any thread: the least recently pushed item (or T{} if empty or we lost a race)
+        T steal()
+        {
+            auto t = top.load(std::memory_order_acquire);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            auto const b = bottom.load(std::memory_order_acquire);
+            if (t >= b) {
+                return T{};
+            }
+            auto const x = array.load(std::memory_order_acquire)->get(t);
+            if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst,
+                                             std::memory_order_relaxed)) {
+                return T{};
+            }
+            return x;
+        }
+
+        // Any thread; only a hint, unless the owner is idle
+        bool empty() const
+        {
+            return bottom.load(std::memory_order_relaxed) <= top.load(std::memory_order_relaxed);
+        }
+
+    private:
+        ring *grow(ring *old, std::int64_t t, std::int64_t b)
+        {
+            auto bigger = std::make_unique<ring>(2 * (old->mask + 1));
+            for (auto i = t;  i < b;  ++i) {
+                bigger->put(i, old->get(i));
+            }
+            rings.push_back(std::move(bigger));
+            array.store(rings.back().get(), std::memory_order_release);
+            return rings.back().get();
+        }
+    };
+
+    // A forked task.  The forking thread owns it and waits for done
+    // before destroying it.
+    struct task
+    {
+        void (*execute)(task&);
+        std::atomic<bool> done = false;
+    };
+}
+
+
+class thread_pool
+{
+    using task = thread_pool_detail::task;
+    using deque = thread_pool_detail::chase_lev_deque<task*>;
+
+    // deques[0] is for the outside thread in parallel_for(); worker i uses deques[i+1]
+    std::vector<std::unique_ptr<deque>> deques = {};
+    std::vector<std::thread> workers = {};
+    std::mutex outside_caller = {};
+
+    std::atomic<unsigned> sleepers = 0;
+    std::atomic<std::uint32_t> wakeups = 0;
+    std::atomic<bool> stopping = false;
+
+    // Failed attempts to find work before a worker sleeps
+    static constexpr unsigned spin_limit = 64;
+
+    // The pool (if any) the current thread is working for, and its deque there
+    struct membership
+    {
+        thread_pool *pool;
+        std::size_t index;
+    };
+    static inline thread_local membership current = {nullptr, 0};
+
+public:
+    // One worker per CPU, less the calling thread.
+    static unsigned default_workers()
+    {
+        return std::max(std::thread::hardware_concurrency(), 1u) - 1;
+    }
+
+    // If cpus is non-empty, worker i is pinned to cpus[i % cpus.size()].
+    explicit thread_pool(unsigned workers = default_workers(), std::vector<int> const& cpus = {})
+    {
+        for (unsigned i = 0;  i <= workers;  ++i) {
+            deques.push_back(std::make_unique<deque>());
+        }
+        try {
+            for (unsigned i = 0;  i < workers;  ++i) {
+                this->workers.emplace_back(&thread_pool::work, this, i + 1);
+                if (!cpus.empty()) {
+                    pin(this->workers.back(), cpus[i % cpus.size()]);
+                }
+            }
+        } catch (...) {
+            stop();
+            throw;
+        }
+    }
+
+    thread_pool(const thread_pool&) = delete;
+    void operator=(const thread_pool&) = delete;
+
+    ~thread_pool()
+    {
+        stop();
+    }
+
+    // Threads that run parallel_for() bodies, including the caller.
+    std::size_t concurrency() const
+    {
+        return workers.size() + 1;
+    }
+
+    template<typename Body>
+    void parallel_for(std::size_t n, Body&& body, std::size_t grain = 0)
+    {
+        if (!grain) {
+            grain = std::max(n / (8 * concurrency()), std::size_t{1});
+        }
+        if (n <= grain || workers.empty()) {
+            if (n) {
+                body(std::size_t{0}, n);
+            }
+            return;
+        }
+
+        job<std::remove_reference_t<Body>> j{body, grain};
+        if (current.pool == this) {
+            run_range(j, 0, n);
+        } else {
+            std::lock_guard lock{outside_caller};
+            auto const previous = std::exchange(current, {this, 0});
+            run_range(j, 0, n);
+            current = previous;
+        }
+        if (j.error) {
+            std::rethrow_exception(j.error);
+        }
+    }
+
+private:
+    template<typename Body>
+    struct job
+    {
+        Body& body;
+        std::size_t const grain;
+        std::atomic<bool> failed = false;
+        std::exception_ptr error = {};
+    };
+
+    template<typename Body>
+    struct range_task : task
+    {
+        job<Body>& j;
+        std::size_t const first;
+        std::size_t const last;
+
+        range_task(job<Body>& j, std::size_t first, std::size_t last)
+            : task{execute_range}, j{j}, first{first}, last{last}
+        {}
+
+        static void execute_range(task& t)
+        {
+            auto& r = static_cast<range_task&>(t);
+            current.pool->run_range(r.j, r.first, r.last);
+            r.done.store(true, std::memory_order_release);
+        }
+    };
+
+    template<typename Body>
+    void run_range(job<Body>& j, std::size_t first, std::size_t last)
+    {
+        auto& own = *deques[current.index];
+        while (last - first > j.grain) {
+            // fork the upper half, and recurse into the lower
+            auto const mid = first + (last - first) / 2;
+            range_task<Body> upper{j, mid, last};
+            own.push(&upper);
+            wake_one();
+            run_range(j, first, mid);
+            if (own.pop() != &upper) {
+                // stolen (and with it, everything older) - help out until it's done
+                while (!upper.done.load(std::memory_order_acquire)) {
+                    if (auto *t = find_work()) {
+                        t->execute(*t);
+                    } else {
+                        std::this_thread::yield();
+                    }
+                }
+                return;
+            }
+            first = mid;
+        }
+
+        if (j.failed.load(std::memory_order_relaxed)) {
+            return;
+        }
+        try {
+            j.body(first, last);
+        } catch (...) {
+            if (!j.failed.exchange(true)) {
+                j.error = std::current_exception();
+            }
+        }
+    }
+
+    task *find_work()
+    {
+        auto const self = current.index;
+        if (auto *t = deques[self]->pop()) {
+            return t;
+        }
+        for (std::size_t i = 1;  i < deques.size();  ++i) {
+            if (auto *t = deques[(self + i) % deques.size()]->steal()) {
+                return t;
+            }
+        }
+        return nullptr;
+    }
+
+    bool any_work() const
+    {
+        return std::ranges::any_of(deques, [](auto const& d){ return !d->empty(); });
+    }
+
+    void wake_one()
+    {
+        // pairs with the fence in work(): either we see the sleeper, or it sees our push
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (sleepers.load(std::memory_order_relaxed)) {
+            wakeups.fetch_add(1, std::memory_order_relaxed);
+            wakeups.notify_one();
+        }
+    }
+
+    void work(std::size_t index)
+    {
+        current = {this, index};
+        unsigned idle = 0;
+        while (!stopping.load(std::memory_order_relaxed)) {
+            if (auto *t = find_work()) {
+                t->execute(*t);
+                idle = 0;
+            } else if (++idle < spin_limit) {
+                std::this_thread::yield();
+            } else {
+                auto const seen = wakeups.load(std::memory_order_relaxed);
+                sleepers.fetch_add(1);
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+                if (!any_work() && !stopping.load()) {
+                    wakeups.wait(seen);
+                }
+                sleepers.fetch_sub(1);
+                idle = 0;
+            }
+        }
+    }
+
+    void stop()
+    {
+        stopping.store(true);
+        wakeups.fetch_add(1);
+        wakeups.notify_all();
+        for (auto& w: workers) {
+            w.join();
+        }
+        workers.clear();
+    }
+
+    static void pin(std::thread& t, int cpu)
+    {
+        if (cpu < 0 || cpu >= CPU_SETSIZE) {
+            throw std::system_error(EINVAL, std::generic_category(), "thread_pool: invalid CPU");
+        }
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(static_cast<std::size_t>(cpu), &set);
+        if (auto const error = pthread_setaffinity_np(t.native_handle(), sizeof set, &set)) {
+            throw std::system_error(error, std::generic_category(), "thread_pool: pinning worker");
+        }
+    }
+};
+
+#endif // THREAD_POOL_HH
@@ -0,0 +1,3 @@
+trace: trace.hh ../median/median.hh ../triple-buffer/buffer.hh ../alloc-count/alloc-count.hh
+trace: CPPFLAGS += -DTRACE_ENABLED
+USING_GTEST += trace
@@ -0,0 +1,134 @@
+#include <gtest/gtest.h>
+
+#include "trace.hh"
+#include "../median/median.hh"
+#include "../triple-buffer/buffer.hh"
+#include "../alloc-count/alloc-count.hh"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <sstream>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+// Events of the given name
+static std::vector<trace::event> events_named(std::string_view name)
+{
+    auto events = trace::snapshot();
+    std::erase_if(events, [name](trace::event const& e){ return e.name != name; });
+    return events;
+}
+
+
+TEST(trace, scope_records_event)
+{
+    auto const before = trace::cycles();
+    {
+        TRACE_SCOPE("scope_records_event");
+        std::this_thread::sleep_for(std::chrono::milliseconds{1});
+    }
+    auto const events = events_named("scope_records_event");
+    ASSERT_EQ(events.size(), 1u);
+    EXPECT_GE(events[0].start, before);
+    EXPECT_GT(events[0].duration, 0u);
+    EXPECT_LE(events[0].start + events[0].duration, trace::cycles());
+}
+
+TEST(trace, ring_keeps_latest)
+{
+    constexpr auto count = trace::ring::capacity + 100;
+    for (std::size_t i = 0;  i < count;  ++i) {
+        TRACE_SCOPE("ring_keeps_latest");
+    }
+    auto const events = events_named("ring_keeps_latest");
+    ASSERT_EQ(events.size(), trace::ring::capacity);
+    EXPECT_TRUE(std::ranges::is_sorted(events, {}, &trace::event::start));
+}
+
+TEST(trace, threads_have_own_rings)
+{
+    std::vector<std::thread> threads;
+    for (int i = 0;  i < 3;  ++i) {
+        threads.emplace_back([]{ TRACE_SCOPE("threads_have_own_rings"); });
+    }
+    for (auto& t: threads) {
+        t.join();
+    }
+    // still available after the threads finish
+    auto const events = events_named("threads_have_own_rings");
+    ASSERT_EQ(events.size(), 3u);
+    EXPECT_NE(events[0].thread, events[1].thread);
+    EXPECT_NE(events[1].thread, events[2].thread);
+}
+
+TEST(trace, thread_init_makes_scopes_allocation_free)
+{
+    std::thread{[]{
+        bool initialised = false;
+        EXPECT_GT(alloc_count::during([&]{ initialised = TRACE_THREAD_INIT(); }).allocations, 0u);
+        EXPECT_TRUE(initialised);
+        EXPECT_NO_ALLOC(TRACE_THREAD_INIT());
+        EXPECT_NO_ALLOC(TRACE_SCOPE("thread_init_makes_scopes_allocation_free"));
+    }}.join();
+    EXPECT_EQ(events_named("thread_init_makes_scopes_allocation_free").size(), 1u);
+}
+
+TEST(trace, dump_while_writing)
+{
+    static const char *const names[] = { "dump_while_writing_a", "dump_while_writing_b" };
+    std::atomic<bool> done = false;
+    std::thread writer{[&]{
+        for (unsigned i = 0;  !done;  ++i) {
+            TRACE_SCOPE(names[i % 2]);
+        }
+    }};
+    bool consistent = true;
+    for (int i = 0;  i < 50;  ++i) {
+        auto const events = trace::snapshot();
+        for (auto const& e: events) {
+            consistent &= e.name != nullptr;
+        }
+        std::this_thread::yield();
+    }
+    done = true;
+    writer.join();
+    EXPECT_TRUE(consistent);
+
+    std::ostringstream os;
+    TRACE_DUMP(os);
+    auto const text = os.str();
+    EXPECT_TRUE(text.starts_with("thread\tname\tstart\tduration\tcpu_cycles"));
+    EXPECT_NE(text.find("\tdump_while_writing_a\t"), text.npos);
+}
+
+TEST(trace, counters)
+{
+    if (!TRACE_ENABLE_COUNTERS()) {
+        GTEST_SKIP() << "perf_event_open not permitted";
+    }
+    {
+        TRACE_SCOPE("counters");
+        volatile int sink = 0;
+        for (int i = 0;  i < 100000;  ++i) {
+            sink = sink + i;
+        }
+    }
+    auto const events = events_named("counters");
+    ASSERT_EQ(events.size(), 1u);
+    EXPECT_NE(events[0].counters[0], trace::no_count);
+    EXPECT_GT(events[0].counters[0], 100000u);
+}
+
+TEST(trace, instrumented_components)
+{
+    EXPECT_EQ(stats::median(std::vector{3, 1, 2}), 2);
+    EXPECT_EQ(events_named("stats::median").size(), 1u);
+
+    triple_buffer<int> buffer;
+    buffer.set_write_complete();
+    EXPECT_NE(buffer.get_read_buffer({}), nullptr);
+    EXPECT_EQ(events_named("triple_buffer::set_write_complete").size(), 1u);
+    EXPECT_EQ(events_named("triple_buffer::get_read_buffer").size(), 1u);
+}
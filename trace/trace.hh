@@ -0,0 +1,383 @@
+#ifndef TRACE_HH
+#define TRACE_HH
+
+/*
+  Hot-path tracing that compiles to nothing unless TRACE_ENABLED is defined
+  (e.g. make CPPFLAGS=-DTRACE_ENABLED caesar-cipher).
+
+  * TRACE_SCOPE("name");        // time from here to the end of the enclosing block
+
+  * TRACE_THREAD_INIT()         // create this thread's ring now, rather than at its first scope
+                                // (false if it can't be allocated)
+
+  * TRACE_ENABLE_COUNTERS()     // also count cycles, cache misses and branch misses in this
+                                // thread's scopes (false if perf_event_open isn't permitted)
+
+  * TRACE_DUMP(std::clog);      // write every thread's recent events, tab-separated
+
+  Durations are in time-stamp counter ticks (rdtsc, not serialised, so good to a few tens of
+  cycles); on other architectures, in nanoseconds.  Each thread records into its own ring of the
+  last ring::capacity events, with no locks or system calls once the ring exists.  Creating the
+  ring locks a mutex and allocates, so the first traced scope on a thread isn't real-time safe:
+  real-time threads should call TRACE_THREAD_INIT() before their first scope.  If the ring can't
+  be allocated, the thread's events are dropped.  Dumping may happen at any time, from any
+  thread; events overwritten while being read are discarded, not torn.  Rings outlive their
+  threads, so events from finished threads can still be dumped.
+
+  Counters are optional because they cost a system call (read()) at each end of every scope.
+  Names must be string literals (or otherwise live for the life of the program).
+ */
+
+#ifndef TRACE_ENABLED
+
+#define TRACE_SCOPE(name) ((void)0)
+#define TRACE_THREAD_INIT() true
+#define TRACE_ENABLE_COUNTERS() false
+#define TRACE_DUMP(os) ((void)0)
+
+#else
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+#define TRACE_SCOPE(name) ::trace::scope TRACE_CONCAT(trace_scope_, __LINE__){name}
+#define TRACE_THREAD_INIT() ::trace::init_thread()
+#define TRACE_ENABLE_COUNTERS() ::trace::enable_counters()
+#define TRACE_DUMP(os) ::trace::dump(os)
+
+namespace trace
+{
+    inline std::uint64_t cycles() noexcept
+    {
+#if defined(__x86_64__) || defined(__i386__)
+        return __rdtsc();
+#else
+        auto const now = std::chrono::steady_clock::now().time_since_epoch();
+        return static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(now).count());
+#endif
+    }
+
+    // Hardware counts for a scope, or no_count where unavailable
+    constexpr std::size_t counter_count = 3;
+    using counts = std::array<std::uint64_t, counter_count>;
+    constexpr std::uint64_t no_count = ~std::uint64_t{0};
+    constexpr const char *counter_names[counter_count] = { "cpu_cycles", "cache_misses", "branch_misses" };
+
+    struct event
+    {
+        std::size_t thread;         // in order of each thread's first event
+        const char *name;
+        std::uint64_t start;
+        std::uint64_t duration;
+        counts counters;
+    };
+
+    // The events of one thread.  Only that thread writes; any thread may read.
+    class ring
+    {
+    public:
+        static constexpr std::size_t capacity = 4096;
+        static_assert(std::has_single_bit(capacity));
+
+    private:
+        // Relaxed atomics, so that a concurrent reader races benignly
+        struct slot
+        {
+            std::atomic<const char*> name = nullptr;
+            std::atomic<std::uint64_t> start = 0;
+            std::atomic<std::uint64_t> duration = 0;
+            std::array<std::atomic<std::uint64_t>, counter_count> counters = {};
+        };
+
+        std::size_t const thread;
+        std::unique_ptr<slot[]> slots;
+        std::atomic<std::uint64_t> head = 0;        // events started
+        std::atomic<std::uint64_t> committed = 0;   // events completely written
+
+    public:
+        explicit ring(std::size_t thread)
+            : thread{thread},
+              slots{std::make_unique<slot[]>(capacity)}
+        {}
+
+        void push(const char *name, std::uint64_t start, std::uint64_t duration, counts const& c) noexcept
+        {
+            auto const h = head.load(std::memory_order_relaxed);
+            auto& s = slots[h % capacity];
+            // claim the slot first, so a reader discards it while we overwrite
+            head.store(h + 1, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_release);
+            s.name.store(name, std::memory_order_relaxed);
+            s.start.store(start, std::memory_order_relaxed);
+            s.duration.store(duration, std::memory_order_relaxed);
+            for (std::size_t i = 0;  i < counter_count;  ++i) {
+                s.counters[i].store(c[i], std::memory_order_relaxed);
+            }
+            committed.store(h + 1, std::memory_order_release);
+        }
+
+        // Append the complete events still in the ring, oldest first.
+        void snapshot(std::vector<event>& out) const
+        {
+            auto const last = committed.load(std::memory_order_acquire);
+            auto const first = last > capacity ? last - capacity : 0;
+            auto const old_size = out.size();
+            for (auto i = first;  i < last;  ++i) {
+                auto const& s = slots[i % capacity];
+                event e{thread, s.name.load(std::memory_order_relaxed),
+                        s.start.load(std::memory_order_relaxed),
+                        s.duration.load(std::memory_order_relaxed), {}};
+                for (std::size_t j = 0;  j < counter_count;  ++j) {
+                    e.counters[j] = s.counters[j].load(std::memory_order_relaxed);
+                }
+                out.push_back(e);
+            }
+            // Discard any that the writer has since started to overwrite
+            std::atomic_thread_fence(std::memory_order_acquire);
+            auto const claimed = head.load(std::memory_order_relaxed);
+            auto const overwritten = claimed > capacity ? claimed - capacity : 0;
+            if (overwritten > first) {
+                auto const lost = static_cast<std::ptrdiff_t>(std::min(overwritten, last) - first);
+                out.erase(out.begin() + static_cast<std::ptrdiff_t>(old_size),
+                          out.begin() + static_cast<std::ptrdiff_t>(old_size) + lost);
+            }
+        }
+    };
+
+    // All the rings, ever
+    class registry
+    {
+        std::mutex mutex = {};
+        std::vector<std::unique_ptr<ring>> rings = {};
+
+    public:
+        static registry& instance()
+        {
+            static registry r;
+            return r;
+        }
+
+        ring& add()
+        {
+            std::lock_guard lock{mutex};
+            rings.push_back(std::make_unique<ring>(rings.size()));
+            return *rings.back();
+        }
+
+        std::vector<event> snapshot()
+        {
+            std::vector<event> events;
+            std::lock_guard lock{mutex};
+            for (auto const& r: rings) {
+                r->snapshot(events);
+            }
+            return events;
+        }
+    };
+
+    // The calling thread's ring, created on first use; null if it can't be created
+    // (in which case, we try again next time).
+    inline ring *this_thread_ring() noexcept
+    {
+        thread_local ring *r = nullptr;
+        if (!r) {
+            try {
+                r = &registry::instance().add();
+            } catch (...) {
+                // drop the event
+            }
+        }
+        return r;
+    }
+
+    // A group of hardware counters for the calling thread (user space only)
+    class perf_counters
+    {
+        std::array<int, counter_count> fds = {-1, -1, -1};
+
+    public:
+        perf_counters()
+        {
+#ifdef __linux__
+            constexpr std::uint64_t configs[counter_count] = {
+                PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES
+            };
+            for (std::size_t i = 0;  i < counter_count;  ++i) {
+                perf_event_attr attr = {};
+                attr.type = PERF_TYPE_HARDWARE;
+                attr.size = sizeof attr;
+                attr.config = configs[i];
+                attr.read_format = PERF_FORMAT_GROUP;
+                attr.disabled = i == 0;
+                attr.exclude_kernel = 1;
+                attr.exclude_hv = 1;
+                auto const fd = ::syscall(SYS_perf_event_open, &attr, 0, -1, i ? fds[0] : -1, 0);
+                if (fd < 0) {
+                    close_all();
+                    return;
+                }
+                fds[i] = static_cast<int>(fd);
+            }
+            ::ioctl(fds[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+#endif
+        }
+
+        perf_counters(const perf_counters&) = delete;
+        void operator=(const perf_counters&) = delete;
+
+        ~perf_counters()
+        {
+            close_all();
+        }
+
+        bool available() const
+        {
+            return fds[0] >= 0;
+        }
+
+        bool read(counts& values) const
+        {
+#ifdef __linux__
+            struct { std::uint64_t nr; counts values; } group;
+            if (available() && ::read(fds[0], &group, sizeof group) == sizeof group) {
+                values = group.values;
+                return true;
+            }
+#endif
+            (void)values;
+            return false;
+        }
+
+    private:
+        void close_all()
+        {
+#ifdef __linux__
+            for (auto& fd: fds) {
+                if (fd >= 0) {
+                    ::close(fd);
+                }
+                fd = -1;
+            }
+#endif
+        }
+    };
+
+    inline thread_local std::unique_ptr<perf_counters> thread_counters = nullptr;
+
+    // Count hardware events in the calling thread's scopes from now on.
+    // Returns false (and counts nothing) if the counters can't be opened.
+    inline bool enable_counters()
+    {
+        if (!thread_counters) {
+            auto c = std::make_unique<perf_counters>();
+            if (!c->available()) {
+                return false;
+            }
+            thread_counters = std::move(c);
+        }
+        return true;
+    }
+
+    // Do now what a thread's first scope would otherwise do: create its ring, and register
+    // thread_counters for destruction.  Returns false if the ring can't be created.
+    inline bool init_thread() noexcept
+    {
+        (void)thread_counters.get();
+        return this_thread_ring() != nullptr;
+    }
+
+    // Records its lifetime as an event
+    class scope
+    {
+        const char *const name;
+        ring *const events;
+        perf_counters const *counters;
+        counts at_start = {};
+        std::uint64_t start;
+
+    public:
+        explicit scope(const char *name) noexcept
+            : name{name},
+              events{this_thread_ring()},
+              counters{thread_counters.get()},
+              start{0}
+        {
+            if (counters && !counters->read(at_start)) {
+                counters = nullptr;
+            }
+            start = cycles();
+        }
+
+        scope(const scope&) = delete;
+        void operator=(const scope&) = delete;
+
+        ~scope()
+        {
+            if (!events) {
+                return;
+            }
+            auto const end = cycles();
+            counts c = {no_count, no_count, no_count};
+            if (counters && counters->read(c)) {
+                for (std::size_t i = 0;  i < counter_count;  ++i) {
+                    c[i] -= at_start[i];
+                }
+            }
+            events->push(name, start, end - start, c);
+        }
+    };
+
+    // All threads' recent events
+    inline std::vector<event> snapshot()
+    {
+        return registry::instance().snapshot();
+    }
+
+    // Write the events as tab-separated lines, with a heading
+    inline void dump(std::ostream& os)
+    {
+        os << "thread\tname\tstart\tduration";
+        for (auto const *counter: counter_names) {
+            os << '\t' << counter;
+        }
+        os << '\n';
+        for (auto const& e: snapshot()) {
+            os << e.thread << '\t' << e.name << '\t' << e.start << '\t' << e.duration;
+            for (auto const c: e.counters) {
+                os << '\t';
+                if (c == no_count) {
+                    os << '-';
+                } else {
+                    os << c;
+                }
+            }
+            os << '\n';
+        }
+    }
+}
+
+#endif // TRACE_ENABLED
+
+#endif // TRACE_HH
@@ -0,0 +1,299 @@
+// Real-time audit of triple_buffer: proves that the writer's operations,
+// and reads that find a frame ready, never allocate, lock or make system
+// calls (where steady_clock is read without one).  Built with TRIPLE_BUFFER_AUDIT, so the buffer counts its own
+// mutex acquisitions; this harness counts allocations (with alloc-count)
+// and system calls (with a seccomp filter that traps them).
+
+#include <gtest/gtest.h>
+
+#include "buffer.hh"
+#include "../alloc-count/alloc-count.hh"
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <thread>
+
+#include <csignal>
+#include <linux/audit.h>
+#include <linux/filter.h>
+#include <linux/seccomp.h>
+#include <sys/prctl.h>
+#include <sys/syscall.h>
+#include <ucontext.h>
+
+namespace
+{
+    // Per-thread counts of things a real-time thread mustn't do
+    thread_local unsigned long syscalls_made = 0;
+    thread_local long last_syscall = -1;
+
+    struct counts
+    {
+        unsigned long allocations, syscalls, mutex_locks, notifications;
+
+        static counts now()
+        {
+            return { alloc_count::now().allocations, syscalls_made,
+                     triple_buffer_audit::mutex_locks, triple_buffer_audit::notifications };
+        }
+
+        counts operator-(const counts& o) const
+        {
+            return { allocations - o.allocations, syscalls - o.syscalls,
+                     mutex_locks - o.mutex_locks, notifications - o.notifications };
+        }
+
+        counts& operator+=(const counts& o)
+        {
+            allocations += o.allocations;
+            syscalls += o.syscalls;
+            mutex_locks += o.mutex_locks;
+            notifications += o.notifications;
+            return *this;
+        }
+
+        bool operator==(const counts&) const = default;
+
+        friend std::ostream& operator<<(std::ostream& os, const counts& c)
+        {
+            return os << c.allocations << " allocations, " << c.syscalls << " syscalls (last "
+                      << last_syscall << "), " << c.mutex_locks << " mutex locks, "
+                      << c.notifications << " notifications";
+        }
+    };
+
+    constexpr counts none = {0, 0, 0, 0};
+
+    // Counts made during f()
+    template<typename F>
+    counts audit(F f)
+    {
+        auto const before = counts::now();
+        f();
+        return counts::now() - before;
+    }
+}
+
+
+// System call counting.  Once installed on a thread, the filter traps
+// every system call except those made from audit_syscall6(); the SIGSYS
+// handler counts the call and makes it on the thread's behalf.
+// Only x86-64 is supported; elsewhere, the audit tests are skipped.
+
+#ifdef __x86_64__
+asm(R"(
+    .text
+    .type audit_syscall6, @function
+audit_syscall6:
+    movq %rdi, %rax
+    movq %rsi, %rdi
+    movq %rdx, %rsi
+    movq %rcx, %rdx
+    movq %r8, %r10
+    movq %r9, %r8
+    movq 8(%rsp), %r9
+    syscall
+audit_syscall_return:
+    ret
+    .size audit_syscall6, .-audit_syscall6
+)");
+
+extern "C" long audit_syscall6(long nr, long a, long b, long c, long d, long e, long f);
+extern "C" const char audit_syscall_return[];
+
+static void count_syscall(int, siginfo_t *info, void *context)
+{
+    ++syscalls_made;
+    last_syscall = info->si_syscall;
+
+    auto& regs = static_cast<ucontext_t*>(context)->uc_mcontext.gregs;
+    if (info->si_syscall == SYS_rt_sigprocmask) {
+        // Operate on the mask that will be restored when the handler returns
+        auto *const mask = &static_cast<ucontext_t*>(context)->uc_sigmask;
+        auto const how = regs[REG_RDI];
+        auto const *const set = reinterpret_cast<const std::uint64_t*>(regs[REG_RSI]);
+        auto *const old = reinterpret_cast<std::uint64_t*>(regs[REG_RDX]);
+        std::uint64_t current;
+        std::memcpy(&current, mask, sizeof current);
+        if (old) {
+            *old = current;
+        }
+        if (set) {
+            current = how == SIG_BLOCK ? current | *set
+                : how == SIG_UNBLOCK ? current & ~*set
+                : *set;
+            // a trapped call with SIGSYS blocked would kill the process
+            current &= ~(std::uint64_t{1} << (SIGSYS - 1));
+            std::memcpy(mask, &current, sizeof current);
+        }
+        regs[REG_RAX] = 0;
+        return;
+    }
+    regs[REG_RAX] = audit_syscall6(info->si_syscall, regs[REG_RDI], regs[REG_RSI], regs[REG_RDX],
+                                   regs[REG_R10], regs[REG_R8], regs[REG_R9]);
+}
+
+#endif
+
+// Start counting this thread's system calls; false if not supported
+static bool install_syscall_audit()
+{
+#ifndef __x86_64__
+    return false;
+#else
+    static bool const handler_installed = []{
+        struct sigaction action = {};
+        action.sa_sigaction = count_syscall;
+        action.sa_flags = SA_SIGINFO | SA_NODEFER;
+        return sigaction(SIGSYS, &action, nullptr) == 0;
+    }();
+    if (!handler_installed) {
+        return false;
+    }
+
+    auto const ip = reinterpret_cast<std::uintptr_t>(audit_syscall_return);
+    auto const ip_low = static_cast<std::uint32_t>(ip);
+    auto const ip_high = static_cast<std::uint32_t>(ip >> 32);
+    sock_filter filter[] = {
+        BPF_STMT(BPF_LD | BPF_W | BPF_ABS, offsetof(seccomp_data, arch)),
+        BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, AUDIT_ARCH_X86_64, 0, 8),
+        BPF_STMT(BPF_LD | BPF_W | BPF_ABS, offsetof(seccomp_data, nr)),
+        // these can't be made from a signal handler
+        BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, SYS_rt_sigreturn, 6, 0),
+        BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, SYS_clone, 5, 0),
+        BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, SYS_clone3, 4, 0),
+        BPF_STMT(BPF_LD | BPF_W | BPF_ABS, offsetof(seccomp_data, instruction_pointer)),
+        BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, ip_low, 0, 3),
+        BPF_STMT(BPF_LD | BPF_W | BPF_ABS, offsetof(seccomp_data, instruction_pointer) + 4),
+        BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, ip_high, 0, 1),
+        BPF_STMT(BPF_RET | BPF_K, SECCOMP_RET_ALLOW),
+        BPF_STMT(BPF_RET | BPF_K, SECCOMP_RET_TRAP),
+    };
+    sock_fprog program = { static_cast<unsigned short>(std::size(filter)), filter };
+    return prctl(PR_SET_NO_NEW_PRIVS, 1, 0, 0, 0) == 0
+        && prctl(PR_SET_SECCOMP, SECCOMP_MODE_FILTER, &program) == 0;
+#endif
+}
+
+// Run f() on a new thread whose system calls are counted
+template<typename F>
+static void in_audited_thread(F f)
+{
+    bool supported = false;
+    std::thread{[&]{
+        supported = install_syscall_audit();
+        if (supported) {
+            f();
+        }
+    }}.join();
+    if (!supported) {
+        GTEST_SKIP() << "seccomp filters not available";
+    }
+}
+
+// The reader's fast path reads steady_clock, which makes no system call
+// only where the kernel serves it from the vDSO.  Elsewhere (e.g. some
+// virtual machines), the fast-path checks can't pass with that clock.
+static bool clock_reads_are_free()
+{
+    bool free = false;
+    in_audited_thread([&]{
+        free = audit([]{ (void)std::chrono::steady_clock::now(); }).syscalls == 0;
+    });
+    return free;
+}
+
+
+TEST(audit, harness_detects_violations)
+{
+    in_audited_thread([]{
+        EXPECT_EQ(audit([]{ delete new int; }).allocations, 1u);
+        EXPECT_EQ(audit([]{ ::syscall(SYS_getpid); }).syscalls, 1u);
+
+        triple_buffer<int> buffer;
+        // a blocking read that times out must lock and wait
+        auto const c = audit([&]{ EXPECT_EQ(buffer.get_read_buffer(std::chrono::milliseconds{1}), nullptr); });
+        EXPECT_EQ(c.mutex_locks, 1u);
+        EXPECT_GT(c.syscalls, 0u);
+    });
+}
+
+TEST(audit, single_thread_operations)
+{
+    if (!clock_reads_are_free()) {
+        GTEST_SKIP() << "steady_clock::now() makes a system call on this host";
+    }
+    in_audited_thread([]{
+        triple_buffer<int> buffer;
+        EXPECT_EQ(audit([&]{ *buffer.get_write_buffer() = 1; }), none);
+        EXPECT_EQ(audit([&]{ buffer.set_write_complete(); }), none);
+        EXPECT_EQ(audit([&]{ EXPECT_NE(buffer.get_read_buffer({}), nullptr); }), none);
+        // polling with no frame ready
+        EXPECT_EQ(audit([&]{ EXPECT_EQ(buffer.get_read_buffer({}), nullptr); }), none);
+        EXPECT_EQ(audit([&]{ (void)buffer.frame_will_be_consumed(std::chrono::milliseconds{1}); }), none);
+
+        coalescing_writer<int> writer{buffer, 8, std::chrono::milliseconds{1}};
+        auto const c = audit([&]{
+            for (int i = 0;  i < 1000;  ++i) {
+                ++*writer.get_write_buffer();
+                writer.set_write_complete();
+            }
+        });
+        EXPECT_EQ(c, none);
+    });
+}
+
+TEST(audit, stress)
+{
+    if (!clock_reads_are_free()) {
+        GTEST_SKIP() << "steady_clock::now() makes a system call on this host";
+    }
+    constexpr std::uint64_t frames = 2'000'000;
+    struct frame { std::uint64_t sequence; std::uint64_t check; };
+    triple_buffer<frame> buffer;
+    std::atomic<bool> done = false;
+
+    counts writer_counts = none;
+    counts reader_counts = none;
+    std::uint64_t frames_read = 0;
+    bool consistent = true;
+
+    std::thread reader{[&]{
+        in_audited_thread([&]{
+            std::uint64_t last = 0;
+            for (bool finished = false;  !finished; ) {
+                finished = done.load();
+                frame *f;
+                auto const c = audit([&]{ f = buffer.get_read_buffer({}); });
+                if (!f) {
+                    continue;
+                }
+                reader_counts += c;
+                ++frames_read;
+                consistent &= f->sequence > last && f->check == ~f->sequence;
+                last = f->sequence;
+            }
+        });
+    }};
+
+    in_audited_thread([&]{
+        for (std::uint64_t i = 1;  i <= frames;  ++i) {
+            writer_counts += audit([&]{
+                auto *const f = buffer.get_write_buffer();
+                f->sequence = i;
+                f->check = ~i;
+                buffer.set_write_complete();
+            });
+        }
+    });
+    done = true;
+    reader.join();
+
+    EXPECT_EQ(writer_counts, none);
+    EXPECT_EQ(reader_counts, none);
+    EXPECT_TRUE(consistent);
+    EXPECT_GT(frames_read, 0u);
+}
@@ -2,8 +2,11 @@
 
 // test_invariant() member function is enabled by including after TEST is defined.
 #include "buffer.hh"
+#include "../alloc-count/alloc-count.hh"
 
 #include <set>
+#include <thread>
+#include <vector>
 
 
 #define EXPECT_INVARIANT(obj) (obj.test_invariant(__FILE__, __LINE__))
@@ -140,3 +143,211 @@ TEST(triple_buffer, read_during_write)
     buffer.set_write_complete();
 }
 
+
+// A clock that only moves when told to
+struct manual_clock
+{
+    using duration = std::chrono::milliseconds;
+    using rep = duration::rep;
+    using period = duration::period;
+    using time_point = std::chrono::time_point<manual_clock>;
+    static constexpr bool is_steady = true;
+
+    static inline time_point current = {};
+    static time_point now() { return current; }
+};
+
+TEST(coalescing_writer, publishes_after_max_updates)
+{
+    triple_buffer<int, manual_clock> buffer;
+    coalescing_writer<int, manual_clock> writer{buffer, 3, std::chrono::hours{1}};
+
+    for (int i = 1;  i <= 2;  ++i) {
+        ++*writer.get_write_buffer();
+        writer.set_write_complete();
+        EXPECT_EQ(buffer.get_read_buffer({}), nullptr);
+    }
+    ++*writer.get_write_buffer();
+    writer.set_write_complete();
+    auto *read = buffer.get_read_buffer({});
+    ASSERT_NE(read, nullptr);
+    EXPECT_EQ(*read, 3);
+    EXPECT_INVARIANT(buffer);
+
+    // updates continue from the published value
+    EXPECT_NE(writer.get_write_buffer(), read);
+    EXPECT_EQ(*writer.get_write_buffer(), 3);
+}
+
+TEST(coalescing_writer, publishes_after_max_delay)
+{
+    triple_buffer<int, manual_clock> buffer;
+    coalescing_writer<int, manual_clock> writer{buffer, 1000000, std::chrono::milliseconds{10}};
+
+    manual_clock::current += std::chrono::milliseconds{5};
+    for (unsigned i = 0;  i < writer.clock_interval;  ++i) {
+        ++*writer.get_write_buffer();
+        writer.set_write_complete();
+    }
+    EXPECT_EQ(buffer.get_read_buffer({}), nullptr);
+
+    // the clock is consulted every clock_interval updates
+    manual_clock::current += std::chrono::milliseconds{5};
+    for (unsigned i = 1;  i < writer.clock_interval;  ++i) {
+        ++*writer.get_write_buffer();
+        writer.set_write_complete();
+    }
+    EXPECT_EQ(buffer.get_read_buffer({}), nullptr);
+    ++*writer.get_write_buffer();
+    writer.set_write_complete();
+    auto *read = buffer.get_read_buffer({});
+    ASSERT_NE(read, nullptr);
+    EXPECT_EQ(*read, 2 * static_cast<int>(writer.clock_interval));
+}
+
+TEST(coalescing_writer, flush)
+{
+    triple_buffer<int, manual_clock> buffer;
+    {
+        coalescing_writer<int, manual_clock> writer{buffer, 100, std::chrono::hours{1}};
+        *writer.get_write_buffer() = 5;
+        writer.set_write_complete();
+        EXPECT_EQ(buffer.get_read_buffer({}), nullptr);
+        writer.flush();
+        auto *read = buffer.get_read_buffer({});
+        ASSERT_NE(read, nullptr);
+        EXPECT_EQ(*read, 5);
+
+        // nothing new to flush
+        writer.flush();
+        EXPECT_EQ(buffer.get_read_buffer({}), nullptr);
+
+        *writer.get_write_buffer() = 6;
+        writer.set_write_complete();
+    }
+    // destructor flushes
+    auto *read = buffer.get_read_buffer({});
+    ASSERT_NE(read, nullptr);
+    EXPECT_EQ(*read, 6);
+}
+
+TEST(coalescing_writer, reader_owns_frames)
+{
+    triple_buffer<std::vector<int>, manual_clock> buffer;
+    coalescing_writer<std::vector<int>, manual_clock> writer{buffer, 1, std::chrono::hours{1}};
+
+    writer.get_write_buffer()->assign(1000, 1);
+    writer.set_write_complete();
+    auto *read = buffer.get_read_buffer({});
+    ASSERT_NE(read, nullptr);
+    EXPECT_EQ(*read, std::vector<int>(1000, 1));
+
+    // the reader's changes don't reach the writer's copy
+    std::ranges::fill(*read, -1);
+    read->push_back(-1);
+    EXPECT_EQ(*writer.get_write_buffer(), std::vector<int>(1000, 1));
+
+    writer.get_write_buffer()->back() = 2;
+    writer.set_write_complete();
+    auto *next = buffer.get_read_buffer({});
+    ASSERT_NE(next, nullptr);
+    EXPECT_NE(next, read);
+    EXPECT_EQ(next->size(), 1000u);
+    EXPECT_EQ(next->front(), 1);
+    EXPECT_EQ(next->back(), 2);
+}
+
+TEST(coalescing_writer, publishes_when_reader_waits)
+{
+    triple_buffer<int, manual_clock> buffer;
+    coalescing_writer<int, manual_clock> writer{buffer, 1000000, std::chrono::hours{1}};
+
+    int value = 0;
+    std::thread reader{[&]{
+        auto *read = buffer.get_read_buffer(std::chrono::seconds{10});
+        value = read ? *read : -1;
+    }};
+    while (!buffer.reader_is_waiting()) {
+        std::this_thread::yield();
+    }
+    *writer.get_write_buffer() = 42;
+    writer.set_write_complete();
+    reader.join();
+    EXPECT_EQ(value, 42);
+    EXPECT_FALSE(buffer.reader_is_waiting());
+}
+
+
+TEST(triple_buffer, sequence_numbers)
+{
+    triple_buffer<int> buffer;
+    EXPECT_EQ(buffer.published_sequence(), 0u);
+    EXPECT_EQ(buffer.last_acquired_sequence(), 0u);
+
+    buffer.set_write_complete();
+    buffer.set_write_complete();
+    EXPECT_EQ(buffer.published_sequence(), 2u);
+    EXPECT_EQ(buffer.last_acquired_sequence(), 0u);
+
+    // frame 1 was dropped
+    EXPECT_NE(buffer.get_read_buffer({}), nullptr);
+    EXPECT_EQ(buffer.last_acquired_sequence(), 2u);
+
+    // no new frame
+    EXPECT_EQ(buffer.get_read_buffer({}), nullptr);
+    EXPECT_EQ(buffer.last_acquired_sequence(), 2u);
+
+    buffer.set_write_complete();
+    EXPECT_NE(buffer.get_read_buffer({}), nullptr);
+    EXPECT_EQ(buffer.last_acquired_sequence(), 3u);
+    EXPECT_INVARIANT(buffer);
+}
+
+TEST(triple_buffer, reader_rate_feedback)
+{
+    using namespace std::chrono_literals;
+    triple_buffer<int, manual_clock> buffer;
+    // no history: assume every frame is wanted
+    EXPECT_EQ(buffer.reader_interval(), 0ms);
+    EXPECT_TRUE(buffer.frame_will_be_consumed(1ms));
+
+    for (int i = 0;  i < 4;  ++i) {
+        manual_clock::current += 50ms;
+        buffer.set_write_complete();
+        EXPECT_NE(buffer.get_read_buffer({}), nullptr);
+    }
+    EXPECT_EQ(buffer.reader_interval(), 50ms);
+
+    // reader has just read, and won't be back for a while
+    EXPECT_FALSE(buffer.frame_will_be_consumed(1ms));
+    // but it will if we don't publish again for long enough
+    EXPECT_TRUE(buffer.frame_will_be_consumed(buffer.reader_interval()));
+    // or if its next read is due
+    manual_clock::current += 49ms;
+    EXPECT_TRUE(buffer.frame_will_be_consumed(1ms));
+}
+
+
+TEST(triple_buffer, operations_do_not_allocate)
+{
+    using namespace std::chrono_literals;
+    triple_buffer<int> buffer;
+    EXPECT_NO_ALLOC(buffer.get_write_buffer());
+    EXPECT_NO_ALLOC(buffer.set_write_complete());
+    EXPECT_NO_ALLOC(buffer.frame_will_be_consumed(1ms));
+    // frame ready, nothing ready, and waiting in vain
+    EXPECT_NO_ALLOC(buffer.get_read_buffer({}));
+    EXPECT_NO_ALLOC(buffer.get_read_buffer({}));
+    EXPECT_NO_ALLOC(buffer.get_read_buffer(1ms));
+}
+
+TEST(coalescing_writer, operations_do_not_allocate)
+{
+    triple_buffer<int, manual_clock> buffer;
+    coalescing_writer<int, manual_clock> writer{buffer, 2, std::chrono::hours{1}};
+    EXPECT_NO_ALLOC(++*writer.get_write_buffer());
+    // coalesced, then published
+    EXPECT_NO_ALLOC(writer.set_write_complete());
+    EXPECT_NO_ALLOC(writer.set_write_complete());
+    EXPECT_NO_ALLOC(writer.set_write_complete(); writer.flush());
+}
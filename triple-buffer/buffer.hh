@@ -4,9 +4,35 @@
 #include <atomic>
 #include <chrono>
 #include <condition_variable>
+#include <cstdint>
 #include <mutex>
 
-template<typename T>
+#include "../trace/trace.hh"
+
+// In a traced build, real-time threads should call TRACE_THREAD_INIT()
+// before their first operation, as creating a thread's trace ring locks
+// and allocates.
+
+// In an audit build (for real-time users), each thread counts the mutex
+// acquisitions and condition-variable notifications it makes, so that
+// tests can prove the fast paths free of them.
+#ifdef TRIPLE_BUFFER_AUDIT
+struct triple_buffer_audit
+{
+    static inline thread_local unsigned long mutex_locks = 0;
+    static inline thread_local unsigned long notifications = 0;
+};
+#define TRIPLE_BUFFER_AUDIT_COUNT(counter) (++triple_buffer_audit::counter)
+#else
+#define TRIPLE_BUFFER_AUDIT_COUNT(counter) ((void)0)
+#endif
+
+// The reader's acquisitions are timed with Clock, for reader-rate
+// feedback.  steady_clock is read without a system call only where the
+// kernel serves it from the vDSO (some virtual machines' clocksources
+// don't); a real-time reader on such a host should supply a clock that
+// needs no system call.
+template<typename T, typename Clock = std::chrono::steady_clock>
 class triple_buffer
 {
     // the actual buffer
@@ -25,6 +51,17 @@ class triple_buffer
     // When the reader catches up, it needs to wait for writer (slow path only)
     std::mutex read_queue_mutex = {};
     std::condition_variable read_queue = {};
+    // Set while the reader is blocked (a hint for coalescing_writer)
+    std::atomic<bool> reader_waiting = false;
+
+    // Reader-rate feedback.  Each buffer carries the sequence number of
+    // the frame written to it; the reader reports the last one it got,
+    // and a moving average of the interval between its acquisitions.
+    std::uint64_t sequence[3] = {};
+    std::uint64_t write_sequence = 0;
+    std::atomic<std::uint64_t> acquired_sequence = 0;
+    std::atomic<typename Clock::rep> last_read_time = 0;
+    std::atomic<typename Clock::rep> read_interval = 0;
 
 public:
 
@@ -39,13 +76,66 @@ public:
     // Writer releases ownership of its buffer.
     void set_write_complete()
     {
+        TRACE_SCOPE("triple_buffer::set_write_complete");
         // give back the write buffer
         auto *written = writebuffer;
+        sequence[written - buffer] = ++write_sequence;
         writebuffer = available.exchange(writebuffer);
         // mark it as written
-        next_read_buf.store(written, std::memory_order_release);
-        // notify any waiting reader
-        read_queue.notify_one();
+        next_read_buf.store(written);
+        // notify any waiting reader (it sets the flag before testing
+        // next_read_buf, so one of us sees the other's store)
+        if (reader_waiting.load()) {
+            TRIPLE_BUFFER_AUDIT_COUNT(mutex_locks);
+            std::lock_guard lock{read_queue_mutex};
+            TRIPLE_BUFFER_AUDIT_COUNT(notifications);
+            read_queue.notify_one();
+        }
+    }
+
+    // True if the reader is blocked waiting for a write.
+    bool reader_is_waiting() const
+    {
+        return reader_waiting.load(std::memory_order_relaxed);
+    }
+
+    // Sequence number of the last frame published (counting from 1).
+    std::uint64_t published_sequence() const
+    {
+        return write_sequence;
+    }
+
+    // Sequence number of the last frame the reader acquired (0 if none).
+    // Frames published between this and published_sequence() will be
+    // dropped if another is published before the reader next reads.
+    std::uint64_t last_acquired_sequence() const
+    {
+        return acquired_sequence.load(std::memory_order_relaxed);
+    }
+
+    // Moving average of the interval between the reader's acquisitions
+    // (zero until it has acquired two frames).
+    typename Clock::duration reader_interval() const
+    {
+        return typename Clock::duration{read_interval.load(std::memory_order_relaxed)};
+    }
+
+    // Predicts whether a frame published now will be read before the
+    // writer's following frame, due after next_publish.  If not, the
+    // writer can skip (or cheapen) this frame.  With no history yet,
+    // every frame is assumed wanted.
+    bool frame_will_be_consumed(typename Clock::duration next_publish) const
+    {
+        auto const interval = reader_interval();
+        if (reader_is_waiting() || interval <= Clock::duration::zero() || next_publish >= interval) {
+            return true;
+        }
+        // when the reader is expected next, assuming it keeps its cadence
+        auto const now = Clock::now().time_since_epoch();
+        auto const last = typename Clock::duration{last_read_time.load(std::memory_order_relaxed)};
+        auto const since = now - last;
+        auto const until_read = since < interval ? interval - since : interval - since % interval;
+        return until_read <= next_publish;
     }
 
     // Reader interface
@@ -54,7 +144,21 @@ public:
     // get_read_buffer().
     T *get_read_buffer(std::chrono::milliseconds timeout = std::chrono::milliseconds::max())
     {
-        auto const timeout_time = std::chrono::steady_clock::now() + timeout;
+        TRACE_SCOPE("triple_buffer::get_read_buffer");
+        auto *const b = acquire(timeout);
+        if (b) {
+            record_acquisition(sequence[b - buffer]);
+        }
+        return b;
+    }
+
+private:
+    T *acquire(std::chrono::milliseconds timeout)
+    {
+        // only a blocking read needs the clock
+        auto const timeout_time = timeout > timeout.zero()
+            ? std::chrono::steady_clock::now() + timeout
+            : std::chrono::steady_clock::time_point{};
 
         // get the written buffer, waiting if necessary
         auto *b = next_read_buf.exchange(nullptr);
@@ -65,11 +169,18 @@ public:
                 // yes, that's it
                 return readbuffer;
             }
-            // else we need to wait for writer
+            // else we need to wait for writer - but not if polling
+            if (timeout <= timeout.zero()) {
+                return nullptr;
+            }
             b = nullptr;
+            TRIPLE_BUFFER_AUDIT_COUNT(mutex_locks);
             std::unique_lock lock{read_queue_mutex};
             auto test = [this,&b]{ b = next_read_buf.exchange(nullptr); return b; };
-            if (!read_queue.wait_until(lock, timeout_time, test)) {
+            reader_waiting.store(true);
+            auto const written = read_queue.wait_until(lock, timeout_time, test);
+            reader_waiting.store(false);
+            if (!written) {
                 return nullptr;
             }
         }
@@ -77,7 +188,23 @@ public:
         return readbuffer;
     }
 
+    void record_acquisition(std::uint64_t frame)
+    {
+        // only the reader writes these, so no read-modify-write is needed
+        auto const now = Clock::now().time_since_epoch().count();
+        auto const last = last_read_time.load(std::memory_order_relaxed);
+        if (acquired_sequence.load(std::memory_order_relaxed)) {
+            // exponential moving average, weight 1/8
+            auto const average = read_interval.load(std::memory_order_relaxed);
+            auto const sample = now - last;
+            read_interval.store(average ? average + (sample - average) / 8 : sample,
+                                std::memory_order_relaxed);
+        }
+        last_read_time.store(now, std::memory_order_relaxed);
+        acquired_sequence.store(frame, std::memory_order_relaxed);
+    }
 
+public:
     // The unit test helper is enabled only if <gtest.h> is included before this header.
     // It's not available (or necessary) in production code.
 #ifdef TEST
@@ -109,4 +236,85 @@ public:
 #endif
 };
 
+
+// Writer front-end for producers that update much faster than the
+// reader samples.  Each update is completed with set_write_complete()
+// as usual, but the buffer is published only when max_updates have
+// accumulated, when max_delay has passed since the last publication,
+// or when the reader is waiting.  Otherwise, completing an update is
+// just a counter increment and a relaxed load.
+//
+// The writer modifies a private copy, which is copied into the triple
+// buffer's write buffer only to publish.  So updates may be incremental,
+// and the reader may do as it likes with the frames it gets.
+//
+// The clock (the buffer's own) is read only every clock_interval
+// updates, so max_delay is approximate.  Call flush() when the producer goes idle.
+template<typename T, typename Clock = std::chrono::steady_clock>
+class coalescing_writer
+{
+    triple_buffer<T, Clock>& buffer;
+    T current;
+    unsigned const max_updates;
+    typename Clock::duration const max_delay;
+    typename Clock::time_point deadline;
+    unsigned pending = 0;
+
+public:
+    static constexpr unsigned clock_interval = 64;
+
+    coalescing_writer(triple_buffer<T, Clock>& buffer, unsigned max_updates,
+                      typename Clock::duration max_delay)
+        : buffer{buffer},
+          current{*buffer.get_write_buffer()},
+          max_updates{max_updates},
+          max_delay{max_delay},
+          deadline{Clock::now() + max_delay}
+    {}
+
+    coalescing_writer(const coalescing_writer&) = delete;
+    void operator=(const coalescing_writer&) = delete;
+
+    ~coalescing_writer()
+    {
+        flush();
+    }
+
+    // Writer has ownership of this buffer (this function never blocks).
+    T *get_write_buffer()
+    {
+        return &current;
+    }
+
+    // Writer has finished one update.
+    void set_write_complete()
+    {
+        ++pending;
+        if (pending >= max_updates
+            || buffer.reader_is_waiting()
+            || (pending % clock_interval == 0 && Clock::now() >= deadline))
+        {
+            publish();
+        }
+    }
+
+    // Publish any outstanding updates now.
+    void flush()
+    {
+        if (pending) {
+            publish();
+        }
+    }
+
+private:
+    void publish()
+    {
+        // copy before publishing, as the reader then owns the frame
+        *buffer.get_write_buffer() = current;
+        buffer.set_write_complete();
+        pending = 0;
+        deadline = Clock::now() + max_delay;
+    }
+};
+
 #endif // TRIPLE_BUFFER_HPP
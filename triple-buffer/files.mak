@@ -1,3 +1,7 @@
-buffer: buffer.hh
+buffer: buffer.hh ../trace/trace.hh ../alloc-count/alloc-count.hh
 
 USING_GTEST += buffer
+
+audit: buffer.hh ../trace/trace.hh ../alloc-count/alloc-count.hh
+audit: CPPFLAGS += -DTRIPLE_BUFFER_AUDIT
+USING_GTEST += audit